@@ -0,0 +1,106 @@
+#!/bin/bash
+
+# Builds raytracing_bench for every ON/OFF combination of the given CMake
+# options, runs it and prints each benchmark's time relative to the build with
+# every option OFF.
+#
+# Usage: compare_options.sh [OPTION...]
+#   Options default to DISABLE_CONST_VAR DISABLE_ASSUME DISABLE_POW
+#   DISABLE_CONSTEXPR. Builds and JSON results go to ./bench_builds; extra
+#   arguments for raytracing_bench can be passed in BENCH_ARGS.
+#
+# The builds are benchmarked in turn for ROUNDS rounds (default: 3) and the
+# fastest time of each is kept, so that drift in machine load affects every
+# combination alike.
+
+# Halts the script if any command returns a non-zero status
+set -e
+
+SOURCE_DIR=$(cd "$(dirname "$0")/.." && pwd)
+WORK_DIR=$(pwd)/bench_builds
+mkdir -p "$WORK_DIR"
+
+if [ $# -gt 0 ]; then
+    VARS=("$@")
+else
+    VARS=(DISABLE_CONST_VAR DISABLE_ASSUME DISABLE_POW DISABLE_CONSTEXPR)
+fi
+NUM_VARS=${#VARS[@]}
+NUM_COMBINATIONS=$((2**NUM_VARS))
+
+ROUNDS=${ROUNDS:-3}
+
+NAMES=()
+for ((i=0; i<NUM_COMBINATIONS; i++)); do
+    CMAKE_FLAGS=""
+    NAME=""
+    # Generate the ON/OFF combination for each variable
+    for ((j=0; j<NUM_VARS; j++)); do
+        if (( (i >> j) & 1 )); then
+            CMAKE_FLAGS+="-D${VARS[j]}=ON "
+            NAME+="1"
+        else
+            CMAKE_FLAGS+="-D${VARS[j]}=OFF "
+            NAME+="0"
+        fi
+    done
+
+    BUILD_DIR="$WORK_DIR/$NAME"
+    echo "cmake ${SOURCE_DIR} $CMAKE_FLAGS" >&2
+    cmake -S "$SOURCE_DIR" -B "$BUILD_DIR" $CMAKE_FLAGS > /dev/null
+    cmake --build "$BUILD_DIR" --target raytracing_bench -j "$(nproc)" \
+        > /dev/null
+    NAMES+=("$NAME")
+done
+
+RESULTS=()
+for ((round=1; round<=ROUNDS; round++)); do
+    for NAME in "${NAMES[@]}"; do
+        echo "Round $round: $NAME" >&2
+        RESULT="$WORK_DIR/$NAME.$round.json"
+        "$WORK_DIR/$NAME/raytracing_bench" $BENCH_ARGS > "$RESULT" \
+            2> /dev/null
+        RESULTS+=("$RESULT")
+    done
+done
+
+# One column per combination, named by its ON/OFF bits in the order of VARS.
+echo "Options: ${VARS[*]}"
+echo "ns/op relative to all OFF (first column, absolute ns/op)"
+awk '
+    /"name":/ {
+        match($0, /"name": "[^"]*"/)
+        name = substr($0, RSTART + 9, RLENGTH - 10)
+        match($0, /"ns_per_op": [0-9.e+-]*/)
+        ns = substr($0, RSTART + 13, RLENGTH - 13) + 0
+        if (!(name in row)) {
+            row[name] = ++num_rows
+            names[num_rows] = name
+        }
+        if (!((label, name) in value) || ns < value[label, name])
+            value[label, name] = ns
+    }
+    FNR == 1 {
+        label = FILENAME
+        sub(/.*\//, "", label)
+        sub(/\..*$/, "", label)
+        if (!(label in seen)) {
+            seen[label] = 1
+            labels[++num_labels] = label
+        }
+    }
+    END {
+        printf "%-24s", "benchmark"
+        for (l = 1; l <= num_labels; l++)
+            printf " %10s", labels[l]
+        printf "\n"
+        for (r = 1; r <= num_rows; r++) {
+            name = names[r]
+            base = value[labels[1], name]
+            printf "%-24s %10.2f", name, base
+            for (l = 2; l <= num_labels; l++)
+                printf " %10.3f", value[labels[l], name] / base
+            printf "\n"
+        }
+    }
+' "${RESULTS[@]}"
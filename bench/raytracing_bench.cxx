@@ -0,0 +1,453 @@
+#include "rtweekend.hpp"
+
+#include "camera.hpp"
+#include "hittable_list.hpp"
+#include "interval.hpp"
+#include "material.hpp"
+#include "render_stats.hpp"
+#include "sampler.hpp"
+#include "scenes.hpp"
+#include "sphere.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Microbenchmarks of the renderer's building blocks and an end-to-end render
+// of the random spheres scene. Results are printed to standard output as a
+// JSON object with one benchmark per line; bench/compare_options.sh runs this
+// for several build option combinations.
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+class bench_result {
+public:
+  std::string name;
+  double ns_per_op;
+  std::uint64_t ops;
+  std::string extra; // Further JSON members, each starting with ", "
+};
+
+class bench_settings {
+public:
+  double min_time = 0.2; // Seconds each timed repetition should last
+  int repetitions = 5;   // The fastest repetition is reported
+  std::string filter;    // Only run benchmarks whose name contains this
+  int render_width = 200;
+  int render_samples = 8;
+};
+
+// Stops the compiler from discarding a value a benchmark computes.
+template <class T> inline void keep(const T &value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Number of inputs each microbenchmark cycles through; a power of two.
+constexpr int num_inputs = 1024;
+
+// Times body(iterations), where one call performs `iterations` operations.
+// The iteration count grows until a call lasts min_time, then the fastest of
+// several repetitions is kept.
+bench_result measure(const bench_settings &settings, const std::string &name,
+                     const std::function<void(std::uint64_t)> &body) {
+  auto seconds = [&](const std::uint64_t iterations) {
+    CONST_VAR auto start = bench_clock::now();
+    body(iterations);
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+  };
+
+  std::uint64_t iterations = num_inputs;
+  while (seconds(iterations) < settings.min_time)
+    iterations *= 2;
+
+  double best = std::numeric_limits<double>::infinity();
+  for (int r = 0; r < settings.repetitions; r++)
+    best = std::min(best, seconds(iterations));
+  return {name, best * 1e9 / iterations, iterations, ""};
+}
+
+// Rays from points around the origin towards points near the unit sphere, so
+// that about half of them hit it.
+std::vector<ray> make_rays(rng &gen) {
+  std::vector<ray> rays;
+  for (int i = 0; i < num_inputs; i++) {
+    CONST_VAR point3 origin = 4 * random_unit_vector(gen);
+    CONST_VAR point3 target = 1.5 * vec3::random(gen, -1, 1);
+    rays.push_back(ray(origin, target - origin));
+  }
+  return rays;
+}
+
+std::vector<vec3> make_vectors(rng &gen) {
+  std::vector<vec3> vectors;
+  for (int i = 0; i < num_inputs; i++)
+    vectors.push_back(vec3::random(gen, -1, 1));
+  return vectors;
+}
+
+// Hit records of rays from make_rays() that hit the unit sphere.
+std::vector<hit_record> make_hits(const std::vector<ray> &rays,
+                                  std::vector<ray> &hit_rays) {
+  CONST_VAR sphere unit_sphere(point3(0, 0, 0), 1, 0);
+  std::vector<hit_record> recs;
+  for (CONST_VAR auto &r : rays) {
+    hit_record rec;
+    if (unit_sphere.hit(r, interval(0.001, 1e9), rec)) {
+      recs.push_back(rec);
+      hit_rays.push_back(r);
+    }
+  }
+  // Pad by repetition so the inputs can be indexed like the others.
+  for (std::size_t i = 0; recs.size() < num_inputs; i++) {
+    recs.push_back(recs[i]);
+    hit_rays.push_back(hit_rays[i]);
+  }
+  return recs;
+}
+
+// Any-hit queries of the rays against world, as shadow rays make them.
+bench_result occluded_bench(const bench_settings &settings,
+                            const std::string &name, const hittable &world,
+                            const std::vector<ray> &rays) {
+  return measure(settings, name, [&](std::uint64_t iterations) {
+    for (std::uint64_t k = 0; k < iterations; k++)
+      keep(world.occluded(rays[k & (num_inputs - 1)], interval(0.001, 1e9)));
+  });
+}
+
+template <class mat_type>
+bench_result scatter_bench(const bench_settings &settings,
+                           const std::string &name, const mat_type &mat,
+                           const std::vector<ray> &rays,
+                           const std::vector<hit_record> &recs) {
+  return measure(settings, name, [&](std::uint64_t iterations) {
+    for (std::uint64_t k = 0; k < iterations; k++) {
+      CONST_VAR int i = int(k & (num_inputs - 1));
+      // The cheapest pattern, so that the material's own work dominates.
+      sampler gen(sample_pattern::random, k, 0, 1);
+      gen.start_bounce(1);
+      colour attenuation;
+      ray scattered;
+      keep(mat.scatter(rays[i], recs[i], attenuation, scattered, gen));
+      keep(scattered);
+    }
+  });
+}
+
+// Sets up a sampler for one of 64 samples of a pixel and draws its first 2D
+// point, as the camera does for every sample.
+bench_result sampler_bench(const bench_settings &settings,
+                           const std::string &pattern_name) {
+  sample_pattern pattern = sample_pattern::random;
+  parse_sample_pattern(pattern_name, pattern);
+  return measure(settings, "sampler_" + pattern_name,
+                 [&](std::uint64_t iterations) {
+                   for (std::uint64_t k = 0; k < iterations; k++) {
+                     sampler gen(pattern, k / 64, std::uint32_t(k % 64), 64);
+                     CONST_VAR sample_2d p = gen.next_2d();
+                     keep(p);
+                   }
+                 });
+}
+
+template <class operation>
+bench_result vec3_bench(const bench_settings &settings,
+                        const std::string &name, const std::vector<vec3> &a,
+                        const std::vector<vec3> &b, const operation &op) {
+  return measure(settings, name, [&](std::uint64_t iterations) {
+    for (std::uint64_t k = 0; k < iterations; k++) {
+      CONST_VAR int i = int(k & (num_inputs - 1));
+      keep(op(a[i], b[i]));
+    }
+  });
+}
+
+// Renders the random spheres scene on one thread and reports the time per
+// camera sample.
+bench_result render_bench(const bench_settings &settings) {
+  CONST_VAR scene spheres = random_spheres_scene("bvh", 0);
+  camera cam;
+  cam.aspect_ratio = 16.0 / 9.0;
+  cam.image_width = settings.render_width;
+  cam.samples_per_pixel = settings.render_samples;
+  cam.max_depth = 50;
+  cam.num_threads = 1;
+  set_random_spheres_view(cam);
+
+  // Silence the progress output while rendering.
+  std::ostringstream progress;
+  auto *saved = std::clog.rdbuf(progress.rdbuf());
+
+  double best = std::numeric_limits<double>::infinity();
+  std::uint64_t rays = 0;
+  for (int r = 0; r < settings.repetitions; r++) {
+    CONST_VAR auto start = bench_clock::now();
+    keep(cam.render(spheres.world, spheres.materials, spheres.lights));
+    CONST_VAR std::chrono::duration<double> elapsed =
+        bench_clock::now() - start;
+    best = std::min(best, elapsed.count());
+    rays = cam.stats.rays();
+  }
+  std::clog.rdbuf(saved);
+
+  CONST_VAR int image_height =
+      std::max(1, int(cam.image_width / cam.aspect_ratio));
+  CONST_VAR std::uint64_t samples =
+      std::uint64_t(cam.image_width) * image_height * cam.samples_per_pixel;
+  std::ostringstream extra;
+  extra << ", \"samples_per_second\": " << samples / best;
+#if ENABLE_STATS
+  extra << ", \"rays_per_second\": " << rays / best;
+#else
+  (void)rays;
+#endif
+  return {"render_random_spheres", best * 1e9 / samples, samples, extra.str()};
+}
+
+// Build options this binary was compiled with, as JSON members.
+std::string build_options() {
+  std::ostringstream out;
+  auto option = [&](const char *name, const bool on) {
+    out << (out.tellp() > 0 ? ", " : "") << '"' << name
+        << "\": " << (on ? "true" : "false");
+  };
+#ifdef DISABLE_CONST_VAR
+  option("DISABLE_CONST_VAR", true);
+#else
+  option("DISABLE_CONST_VAR", false);
+#endif
+#ifdef DISABLE_ASSUME
+  option("DISABLE_ASSUME", true);
+#else
+  option("DISABLE_ASSUME", false);
+#endif
+#ifdef DISABLE_POW
+  option("DISABLE_POW", true);
+#else
+  option("DISABLE_POW", false);
+#endif
+#ifdef CONSTEXPR_NOT_INLINE
+  option("DISABLE_CONSTEXPR", false);
+#else
+  option("DISABLE_CONSTEXPR", true);
+#endif
+#ifdef __AVX2__
+  option("ENABLE_AVX2", true);
+#else
+  option("ENABLE_AVX2", false);
+#endif
+#ifdef ENABLE_STATS
+  option("ENABLE_STATS", true);
+#else
+  option("ENABLE_STATS", false);
+#endif
+#ifdef ENABLE_FLOAT
+  option("ENABLE_FLOAT", true);
+#else
+  option("ENABLE_FLOAT", false);
+#endif
+#ifdef ENABLE_SIMD_VEC3
+  option("ENABLE_SIMD_VEC3", true);
+#else
+  option("ENABLE_SIMD_VEC3", false);
+#endif
+  return out.str();
+}
+
+void help() {
+  std::clog << "Usage: raytracing_bench [options]\n";
+  std::clog << "Options:\n";
+  std::clog << "  -h, --help\t\tShow this help message\n";
+  std::clog << "      --filter\t\tOnly run benchmarks whose name contains "
+               "this\n";
+  std::clog << "      --min-time\t\tSeconds per timed repetition (default: "
+               "0.2)\n";
+  std::clog << "      --repetitions\tTimed repetitions, the fastest is kept "
+               "(default: 5)\n";
+  std::clog << std::flush;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  bench_settings settings;
+  for (int i = 1; i < argc; i++) {
+    CONST_VAR std::string arg(argv[i]);
+    if (arg == "-h" or arg == "--help") {
+      help();
+      return 0;
+    } else if (arg == "--filter" and i + 1 < argc) {
+      settings.filter = argv[++i];
+    } else if (arg == "--min-time" and i + 1 < argc) {
+      settings.min_time = std::stod(argv[++i]);
+    } else if (arg == "--repetitions" and i + 1 < argc) {
+      settings.repetitions = std::max(1, std::stoi(argv[++i]));
+    } else {
+      std::cerr << "Unknown option: " << arg << '\n';
+      help();
+      return 1;
+    }
+  }
+
+  rng gen(12345);
+  CONST_VAR std::vector<ray> rays = make_rays(gen);
+  CONST_VAR std::vector<vec3> a = make_vectors(gen);
+  CONST_VAR std::vector<vec3> b = make_vectors(gen);
+  std::vector<vec3> unit_normals;
+  for (CONST_VAR auto &v : a)
+    unit_normals.push_back(unit_vector(v));
+  std::vector<ray> hit_rays;
+  CONST_VAR std::vector<hit_record> recs = make_hits(rays, hit_rays);
+  CONST_VAR scene list_scene = random_spheres_scene("list", 0);
+  CONST_VAR scene set_scene = random_spheres_scene("sphere_set", 0);
+  CONST_VAR scene bvh_scene = random_spheres_scene("bvh", 0);
+  CONST_VAR sphere unit_sphere(point3(0, 0, 0), 1, 0);
+
+  std::vector<std::pair<std::string, std::function<bench_result()>>> benches;
+  benches.push_back({"sphere_hit", [&] {
+    return measure(settings, "sphere_hit", [&](std::uint64_t iterations) {
+      for (std::uint64_t k = 0; k < iterations; k++) {
+        hit_record rec;
+        keep(unit_sphere.hit(rays[k & (num_inputs - 1)],
+                             interval(0.001, 1e9), rec));
+        keep(rec);
+      }
+    });
+  }});
+  benches.push_back({"hittable_list_hit", [&] {
+    // The list of every sphere in the random spheres scene.
+    bench_result result = measure(
+        settings, "hittable_list_hit", [&](std::uint64_t iterations) {
+          for (std::uint64_t k = 0; k < iterations; k++) {
+            hit_record rec;
+            keep(list_scene.world.hit(rays[k & (num_inputs - 1)],
+                                      interval(0.001, 1e9), rec));
+            keep(rec);
+          }
+        });
+    // Arena storage of each sphere plus its pointer in the list.
+    CONST_VAR std::size_t count = list_scene.world.objects.size();
+    std::ostringstream extra;
+    extra << ", \"bytes_per_primitive\": "
+          << double(list_scene.objects.bytes_used()) / count +
+                 sizeof(list_scene.world.objects[0]);
+    result.extra = extra.str();
+    return result;
+  }});
+  benches.push_back({"sphere_set_hit", [&] {
+    // The same spheres in one SIMD sphere_set.
+    return measure(settings, "sphere_set_hit", [&](std::uint64_t iterations) {
+      for (std::uint64_t k = 0; k < iterations; k++) {
+        hit_record rec;
+        keep(set_scene.world.hit(rays[k & (num_inputs - 1)],
+                                 interval(0.001, 1e9), rec));
+        keep(rec);
+      }
+    });
+  }});
+  benches.push_back({"bvh_hit", [&] {
+    // The same spheres in the scene's BVH.
+    return measure(settings, "bvh_hit", [&](std::uint64_t iterations) {
+      for (std::uint64_t k = 0; k < iterations; k++) {
+        hit_record rec;
+        keep(bvh_scene.world.hit(rays[k & (num_inputs - 1)],
+                                 interval(0.001, 1e9), rec));
+        keep(rec);
+      }
+    });
+  }});
+  benches.push_back({"sphere_occluded", [&] {
+    return occluded_bench(settings, "sphere_occluded", unit_sphere, rays);
+  }});
+  benches.push_back({"hittable_list_occluded", [&] {
+    return occluded_bench(settings, "hittable_list_occluded",
+                          list_scene.world, rays);
+  }});
+  benches.push_back({"sphere_set_occluded", [&] {
+    return occluded_bench(settings, "sphere_set_occluded", set_scene.world,
+                          rays);
+  }});
+  benches.push_back({"bvh_occluded", [&] {
+    return occluded_bench(settings, "bvh_occluded", bvh_scene.world, rays);
+  }});
+  benches.push_back({"lambertian_scatter", [&] {
+    return scatter_bench(settings, "lambertian_scatter",
+                         lambertian(colour(0.5, 0.5, 0.5)), hit_rays, recs);
+  }});
+  benches.push_back({"metal_scatter", [&] {
+    return scatter_bench(settings, "metal_scatter",
+                         metal(colour(0.7, 0.6, 0.5), 0.3), hit_rays, recs);
+  }});
+  benches.push_back({"dielectric_scatter", [&] {
+    return scatter_bench(settings, "dielectric_scatter", dielectric(1.5),
+                         hit_rays, recs);
+  }});
+  benches.push_back({"random_unit_vector", [&] {
+    return measure(settings, "random_unit_vector",
+                   [&](std::uint64_t iterations) {
+                     rng gen(1);
+                     for (std::uint64_t k = 0; k < iterations; k++)
+                       keep(random_unit_vector(gen));
+                   });
+  }});
+  for (const char *pattern : {"random", "stratified", "halton", "sobol"}) {
+    benches.push_back({std::string("sampler_") + pattern,
+                       [&settings, pattern] {
+                         return sampler_bench(settings, pattern);
+                       }});
+  }
+  benches.push_back({"refract", [&] {
+    return vec3_bench(settings, "refract", unit_normals, b,
+                      [](const vec3 &uv, const vec3 &n) {
+                        return refract(unit_vector(uv), unit_vector(n),
+                                       1 / 1.5);
+                      });
+  }});
+  benches.push_back({"vec3_add", [&] {
+    return vec3_bench(settings, "vec3_add", a, b,
+                      [](const vec3 &u, const vec3 &v) { return u + v; });
+  }});
+  benches.push_back({"vec3_scale", [&] {
+    return vec3_bench(settings, "vec3_scale", a, b,
+                      [](const vec3 &u, const vec3 &v) { return v.x() * u; });
+  }});
+  benches.push_back({"vec3_dot", [&] {
+    return vec3_bench(settings, "vec3_dot", a, b,
+                      [](const vec3 &u, const vec3 &v) { return dot(u, v); });
+  }});
+  benches.push_back({"vec3_cross", [&] {
+    return vec3_bench(settings, "vec3_cross", a, b,
+                      [](const vec3 &u, const vec3 &v) { return cross(u, v); });
+  }});
+  benches.push_back({"vec3_unit_vector", [&] {
+    return vec3_bench(settings, "vec3_unit_vector", a, b,
+                      [](const vec3 &u, const vec3 &) {
+                        return unit_vector(u);
+                      });
+  }});
+  benches.push_back(
+      {"render_random_spheres", [&] { return render_bench(settings); }});
+
+  std::cout << "{\n\"options\": {" << build_options() << "},\n";
+  std::cout << "\"benchmarks\": [\n";
+  bool first = true;
+  for (CONST_VAR auto &bench : benches) {
+    if (bench.first.find(settings.filter) == std::string::npos)
+      continue;
+    std::clog << "Running " << bench.first << '\n';
+    CONST_VAR bench_result result = bench.second();
+    std::cout << (first ? "" : ",\n") << "{\"name\": \"" << result.name
+              << "\", \"ns_per_op\": " << result.ns_per_op
+              << ", \"ops\": " << result.ops << result.extra << "}"
+              << std::flush;
+    first = false;
+  }
+  std::cout << "\n]\n}\n";
+}
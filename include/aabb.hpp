@@ -0,0 +1,42 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "interval.hpp"
+#include "ray.hpp"
+#include "rtweekend.hpp"
+#include "vec3.hpp"
+
+// Axis-aligned bounding box.
+class aabb {
+public:
+  interval x, y, z;
+
+  aabb(); // The default AABB is empty, since intervals are empty by default.
+
+  aabb(const interval &x, const interval &y, const interval &z);
+
+  // Treat the two points a and b as extrema for the bounding box, so we don't
+  // require a particular minimum/maximum coordinate order.
+  aabb(const point3 &a, const point3 &b);
+
+  // The tightest box enclosing both box0 and box1.
+  aabb(const aabb &box0, const aabb &box1);
+
+  const interval &axis_interval(const int n) const;
+
+  bool hit(const ray &r, interval ray_t) const;
+
+  // Slab test against a precomputed reciprocal ray direction, for traversal
+  // loops that test many boxes against the same ray.
+  bool hit(const point3 &origin, const vec3 &inv_direction,
+           interval ray_t) const;
+
+  // Index of the axis along which the box is longest.
+  int longest_axis() const;
+
+  point3 centroid() const;
+
+  real surface_area() const;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Allocates objects one after another in large blocks and destroys them all
+// at once, when the arena is destroyed or cleared; single objects cannot be
+// freed. Objects never move, so moving the arena keeps pointers to them
+// valid.
+class arena {
+public:
+  explicit arena(const std::size_t block_size = 1 << 16);
+  ~arena();
+
+  arena(const arena &) = delete;
+  arena &operator=(const arena &) = delete;
+  arena(arena &&other) noexcept;
+  arena &operator=(arena &&other) noexcept;
+
+  // Constructs a T from args in the arena.
+  template <class T, class... Args> T *make(Args &&...args) {
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "arena blocks are only aligned for std::max_align_t");
+    T *object = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value)
+      add_destructor(object, sizeof(T), &destroy<T>);
+    return object;
+  }
+
+  // Destroys every object and frees every block.
+  void clear();
+
+  // Bytes handed out so far, including alignment padding.
+  std::size_t bytes_used() const;
+
+private:
+  // Consecutive objects of one type made one after another, destroyed
+  // together so that bulk allocations need no bookkeeping per object.
+  class destructor_run {
+  public:
+    void (*destroy)(void *);
+    char *first;
+    std::size_t size;
+    std::size_t count;
+  };
+
+  template <class T> static void destroy(void *object) {
+    static_cast<T *>(object)->~T();
+  }
+
+  void *allocate(const std::size_t size, const std::size_t alignment);
+  void add_destructor(void *object, const std::size_t size,
+                      void (*destroy)(void *));
+  void destroy_all();
+
+  std::size_t block_size;
+  std::vector<std::unique_ptr<char[]>> blocks;
+  char *next = nullptr; // Free space of the last block
+  char *end = nullptr;
+  std::size_t used = 0;
+  std::vector<destructor_run> destructors;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "aabb.hpp"
+#include "hittable.hpp"
+#include "hittable_list.hpp"
+#include "interval.hpp"
+#include "rtweekend.hpp"
+
+#include <memory>
+#include <vector>
+
+// Bounding volume hierarchy over the objects of a hittable_list. The tree is
+// built top-down with binned surface area heuristic (SAH) splits and stored as
+// a flat array of nodes in depth-first order, so the left child of an interior
+// node always follows it directly.
+class bvh_node : public hittable {
+public:
+  bvh_node(const hittable_list &list);
+
+  bool intersect(const ray &r, interval ray_t,
+                 hit_candidate &hit) const override;
+
+  bool occluded(const ray &r, interval ray_t) const override;
+
+  // Forwards to the object that was hit.
+  void finalize(const ray &r, const hit_candidate &hit,
+                hit_record &rec) const override;
+
+  // Traverses the tree once for the whole packet, descending into a node if
+  // any active lane hits its box.
+  unsigned intersect_packet(ray_packet &packet,
+                            hit_candidate *hits) const override;
+
+  aabb bounding_box() const override;
+
+private:
+  class node {
+  public:
+    aabb bbox;
+    int first;      // Leaf: first object index. Interior: right child index.
+    int count;      // Number of objects in a leaf, 0 for interior nodes
+    int split_axis; // Axis the children were partitioned along
+  };
+
+  // Per-object data used only while building the tree.
+  class build_entry {
+  public:
+    aabb bbox;
+    point3 centroid;
+    const hittable *object;
+  };
+
+  static constexpr int num_bins = 16;
+  // Cost of visiting an interior node relative to intersecting one object.
+  static constexpr double traversal_cost = 1.0;
+  static constexpr int max_leaf_size = 4;
+  // Beyond this depth nodes are split at the median so that the traversal
+  // stack in intersect() cannot overflow.
+  static constexpr int max_sah_depth = 64;
+  static constexpr int max_stack_depth = 128;
+
+  std::vector<const hittable *> objects;
+  std::vector<node> nodes;
+  // Keeps the objects the list owned alive.
+  std::vector<std::shared_ptr<const hittable>> owners;
+
+  int build(std::vector<build_entry> &entries, const int start, const int end,
+            const int depth);
+
+  int make_leaf(const std::vector<build_entry> &entries, const aabb &bbox,
+                const int start, const int end);
+};
+
+#endif
@@ -2,8 +2,19 @@
 #define CAMERA_H
 
 #include "colour.hpp"
+#include "framebuffer.hpp"
 #include "hittable.hpp"
+#include "light.hpp"
 #include "material.hpp"
+#include "render_stats.hpp"
+#include "sampler.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class thread_pool;
 
 class camera {
 public:
@@ -11,6 +22,7 @@ public:
   int image_width = 100;      // Rendered image width in pixel count
   int samples_per_pixel = 10; // Count of random samples for each pixel
   int max_depth = 10;         // Maximum number of ray bounces into scene
+  int roulette_depth = 3;     // Bounces before Russian roulette (<0: never)
 
   double vfov = 90;                  // Vertical view angle (field of view)
   point3 lookfrom = point3(0, 0, 0); // Point camera is looking from
@@ -21,28 +33,192 @@ public:
   double focus_dist =
       10; // Distance from camera lookfrom point to plane of perfect focus
 
-  void render(const hittable &world);
+  double sky_brightness = 1;  // Scale of the sky (0 leaves only the lights)
+  bool light_sampling = true; // Sample the lights at diffuse surfaces
+
+  int num_threads = 0;      // Render threads (0 uses every hardware thread)
+  int tile_size = 16;       // Edge length of the square tiles handed to threads
+  bool packet_mode = false; // Trace camera rays in coherent packets
+  bool wavefront = false;   // Advance batches of paths one bounce at a time
+  bool record_cost = false; // Time every pixel into the framebuffer's costs
+  // Fill the framebuffer's albedo and normal features for denoise(). This
+  // only concerns one render, so scene files do not hold it.
+  bool record_features = false;
+
+  // Adaptive sampling: when adaptive_threshold > 0, a pixel stops taking
+  // samples once the estimated error of its gamma corrected luminance falls
+  // below adaptive_threshold / 2. samples_per_pixel is then the upper bound.
+  // Only the default single-ray path samples adaptively, and the estimate
+  // starts afresh in every pass of a progressive or time_budget render and
+  // when carrying on from a checkpoint, which does not hold it.
+  double adaptive_threshold = 0; // Relative error target (0 disables)
+  int min_samples = 16;          // Samples every pixel takes before stopping
+
+  // When checkpoint_path is not empty, render() saves the finished tiles to
+  // it every checkpoint_interval seconds and once at the end; see
+  // write_checkpoint(). The checkpoints are marked with
+  // checkpoint_fingerprint; see render_fingerprint(). Unlike the settings
+  // above, scene files do not hold these.
+  std::string checkpoint_path;
+  double checkpoint_interval = 60;
+  std::uint64_t checkpoint_fingerprint = 0;
+
+  // Progressive rendering: when preview is set, render() takes the samples
+  // in passes over the whole frame, up to 1, 2, 4, ... samples per pixel
+  // and finally samples_per_pixel, and hands the image to preview after
+  // every pass. With preview_scale > 1, a pass of one sample per
+  // preview_scale by preview_scale block of pixels comes first, for a quick
+  // first look; its samples are not kept. Passes take the same samples as
+  // rendering all at once. render_processes() renders in one pass and only
+  // hands over the finished image.
+  std::function<void(const framebuffer &)> preview;
+  int preview_scale = 8;
+
+  // When time_budget > 0, render() takes passes over the whole frame until
+  // time_budget seconds after it started, with samples_per_pixel as the most
+  // any pixel takes. The first pass takes one sample per pixel, and each
+  // later one about half of the time left, as measured by the pass before.
+  // Tiles not started by the deadline are skipped, except in the first pass,
+  // so pixels may differ by a pass in their samples; each pixel is the mean
+  // of its own. With record_features, the features are rendered before the
+  // first pass, inside the budget. render_processes() ignores it.
+  double time_budget = 0;
+
+  // Points the samples of every pixel are drawn from. Scene files do not
+  // hold this either.
+  sample_pattern sampling = sample_pattern::sobol;
+
+  // Work counters of the last render. Apart from the thread count and the
+  // tile and total times, they are only counted with ENABLE_STATS.
+  render_stats stats;
+
+  // Height of the image, from image_width and aspect_ratio.
+  int height() const;
+
+  // Renders the world into a framebuffer of image_width by height(). Given
+  // an image of that size that already holds samples of this view (read back
+  // from a checkpoint, say), the render adds to it instead: every pixel
+  // continues its sequence of samples up to samples_per_pixel, so none is
+  // taken twice. With the random and sobol patterns the result matches
+  // rendering all of them at once. The stratified and halton patterns lay
+  // their samples out for samples_per_pixel, so this only holds if the
+  // image was started with the same samples_per_pixel, which
+  // render_fingerprint() includes for them.
+  //
+  // lights are the emitting spheres of the world. With light_sampling, every
+  // bounce off a diffuse surface also traces a shadow ray towards a point on
+  // one of them (next-event estimation), and what it finds is combined with
+  // what the bounce's own ray finds by multiple importance sampling.
+  framebuffer render(const hittable &world, const material_table &materials,
+                     const light_list &lights,
+                     framebuffer image = framebuffer());
+
+  // Renders the same image as render(), but in num_workers processes forked
+  // from this one. The coordinator (this process) hands each worker tiles
+  // over a pipe and replaces the tile's pixel sums and sample counts in the
+  // image with the totals it sends back, as the worker started from the same
+  // ones. A worker that dies is replaced and its unfinished tiles are handed
+  // out again; should workers keep dying, this process renders the rest
+  // itself. Each worker renders on one thread.
+  framebuffer render_processes(const hittable &world,
+                               const material_table &materials,
+                               const light_list &lights,
+                               const int num_workers,
+                               framebuffer image = framebuffer());
 
 private:
-  int image_height;           // Rendered image height
-  double pixel_samples_scale; // colour scale factor for a sum of pixel samples
-  point3 center;              // Camera center
-  point3 pixel00_loc;         // Location of pixel 0, 0
-  vec3 pixel_delta_u;         // Offset to pixel to the right
-  vec3 pixel_delta_v;         // Offset to pixel below
-  vec3 u, v, w;               // Camera frame basis vectors
-  vec3 defocus_disk_u;        // Defocus disk horizontal radius
-  vec3 defocus_disk_v;        // Defocus disk vertical radius
+  int image_height;    // Rendered image height
+  point3 center;       // Camera center
+  point3 pixel00_loc;  // Location of pixel 0, 0
+  vec3 pixel_delta_u;  // Offset to pixel to the right
+  vec3 pixel_delta_v;  // Offset to pixel below
+  vec3 u, v, w;        // Camera frame basis vectors
+  vec3 defocus_disk_u; // Defocus disk horizontal radius
+  vec3 defocus_disk_v; // Defocus disk vertical radius
+
+  const material_table *materials = nullptr; // Materials of the scene
+  const light_list *lights = nullptr;        // Lights of the scene
+  int sample_limit; // Samples each pixel is taken up to in this pass
+
+  // A rectangle of pixels [x0, x1) x [y0, y1) rendered as one unit of work.
+  class tile {
+  public:
+    int x0, y0, x1, y1;
+  };
 
   void initialize();
 
-  ray get_ray(int i, int j) const;
+  std::vector<tile> make_tiles() const;
+
+  // image if it is image_width by image_height, otherwise an empty image of
+  // that size.
+  framebuffer start_image(framebuffer image) const;
+
+  // The first preview of a progressive render, at 1 / preview_scale of the
+  // resolution, scaled up to the size of the image.
+  void render_coarse_preview(const hittable &world, thread_pool &pool) const;
+
+  // Samples taken by the pixel with the fewest, and over all pixels.
+  static int fewest_samples(const framebuffer &image);
+  static std::uint64_t total_samples(const framebuffer &image);
+
+  // Samples taken over all pixels of t.
+  static std::uint64_t tile_samples(const tile &t, const framebuffer &image);
+
+  // Sets stats from the per-thread (or per-worker) counters of a render.
+  void finish_render(const framebuffer &image,
+                     const std::vector<render_stats> &thread_stats,
+                     const int threads, const double seconds);
+
+  // The loop of a worker process of render_processes(): renders each tile
+  // index read from requests and writes the result to results, until
+  // requests is closed.
+  void serve_tiles(const hittable &world, const std::vector<tile> &tiles,
+                   framebuffer image, const int requests,
+                   const int results) const;
+
+  void render_tile(const hittable &world, const tile &t,
+                   framebuffer &image) const;
+
+  void render_tile_packets(const hittable &world, const tile &t,
+                           framebuffer &image) const;
+
+  void render_tile_wavefront(const hittable &world, const tile &t,
+                             framebuffer &image) const;
+
+  // Traces feature_samples paths through every pixel (the pixel's first
+  // samples, or all of them if it has fewer but some) and averages the
+  // albedo and normal of the first diffuse surface each one reaches, through
+  // up to feature_depth bounces off metal and glass, into image's features.
+  // A pass of its own, as it is cheap and the same however the image was
+  // rendered.
+  void render_features(const hittable &world, framebuffer &image,
+                       thread_pool &pool) const;
+
+  static constexpr int feature_samples = 8;
+  static constexpr int feature_depth = 4;
+
+  // Adaptive pixels test for convergence after this many samples at a time.
+  static constexpr int adaptive_check_interval = 8;
+
+  // Upper bound on the number of paths traced together in wavefront mode.
+  static constexpr int wavefront_batch_size = 1 << 14;
+
+  ray get_ray(int i, int j, sampler &gen) const;
+
+  vec3 sample_square(sampler &gen) const;
+
+  point3 defocus_disk_sample(sampler &gen) const;
 
-  vec3 sample_square() const;
+  colour ray_colour(const ray &r, const hittable &world, sampler &gen) const;
 
-  point3 defocus_disk_sample() const;
+  // Light arriving along r, which is known to hit the world at rec.
+  colour hit_colour(ray r, hit_record rec, const hittable &world,
+                    sampler &gen) const;
 
-  colour ray_colour(const ray &r, int depth, const hittable &world) const;
+  // Light arriving along r, which escapes the world, before scaling by
+  // sky_brightness.
+  static colour background(const ray &r);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "framebuffer.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+class camera;
+class scene;
+
+// A checkpoint holds the sample sum and count of every pixel of a
+// framebuffer, so that a render can carry on from it: an 8-byte magic, the
+// width and height as 32-bit integers, the render's fingerprint as a 64-bit
+// integer, then per pixel three doubles and a 64-bit count, row by row, in
+// native byte order.
+
+// A hash of what decides the samples of a pixel: the spheres and materials
+// of the scene, the camera's view, depth limits, sky and light sampling, and
+// the sample pattern, along with samples_per_pixel for the stratified and
+// halton patterns, which lay their samples out for it. Samples only carry on
+// from a checkpoint with the same fingerprint. Threads, tiles, the tracing
+// path and otherwise samples_per_pixel leave the samples as they are, so
+// they are left out.
+std::uint64_t render_fingerprint(const camera &cam, const scene &s);
+
+// Writes image, rendered as fingerprint, to a temporary file next to path,
+// flushes it to disk and renames it over path, so that path always holds a
+// whole checkpoint, the old one or the new one. Returns false and prints the
+// reason to std::cerr on failure.
+bool write_checkpoint(const framebuffer &image,
+                      const std::uint64_t fingerprint,
+                      const std::string &path);
+
+// Reads a checkpoint into image and the fingerprint it was rendered as.
+// Returns false and prints the reason to std::cerr on failure.
+bool read_checkpoint(const std::string &path, framebuffer &image,
+                     std::uint64_t &fingerprint);
+
+// Saves the progress of a render: keeps a copy of the image that only
+// receives whole tiles, and writes it to path at most every interval seconds,
+// so that no checkpoint holds a partly rendered tile.
+class checkpoint_writer {
+public:
+  // start is the image the render adds to.
+  checkpoint_writer(const std::string &path, const double interval,
+                    const std::uint64_t fingerprint, const framebuffer &start);
+
+  // Takes the pixels [x0, x1) x [y0, y1) of image, which are finished, and
+  // writes a checkpoint if interval seconds have passed since the last one.
+  // Threads may call this concurrently for disjoint pixels.
+  void add_finished(const framebuffer &image, const int x0, const int y0,
+                    const int x1, const int y1);
+
+  // Writes a checkpoint now.
+  bool write();
+
+private:
+  std::mutex lock;
+  std::string path;
+  double interval;
+  std::uint64_t fingerprint;
+  framebuffer snapshot;
+  std::chrono::steady_clock::time_point last_write;
+};
+
+#endif
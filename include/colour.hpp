@@ -1,12 +1,9 @@
 #ifndef colour_H
 #define colour_H
 
-#include "interval.hpp"
 #include "rtweekend.hpp"
 #include "vec3.hpp"
 
-#include <iostream>
-
 using colour = vec3;
 
 inline double linear_to_gamma(CONST_VAR double linear_component) {
@@ -17,23 +14,9 @@ inline double linear_to_gamma(CONST_VAR double linear_component) {
   return 0;
 }
 
-inline void write_colour(std::ostream &out, const colour &pixel_colour,
-                         interval &intensity) {
-  auto r = pixel_colour.x();
-  auto g = pixel_colour.y();
-  auto b = pixel_colour.z();
-
-  // Apply a linear to gamma transform for gamma 2
-  r = linear_to_gamma(r);
-  g = linear_to_gamma(g);
-  b = linear_to_gamma(b);
-
-  int rbyte = int(256 * intensity.clamp(r));
-  int gbyte = int(256 * intensity.clamp(g));
-  int bbyte = int(256 * intensity.clamp(b));
-
-  // Write out the pixel colour components.
-  out << rbyte << ' ' << gbyte << ' ' << bbyte << '\n';
+// Relative luminance of a linear colour (Rec. 709 primaries).
+inline double luminance(const colour &c) {
+  return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
 }
 
 #endif
\ No newline at end of file
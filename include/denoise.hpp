@@ -0,0 +1,29 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "framebuffer.hpp"
+
+// Settings of denoise(). Each sigma is how far apart two pixels may be in
+// one feature before the filter mostly stops mixing them: smaller keeps
+// sharper edges but removes less noise.
+class denoise_settings {
+public:
+  int iterations = 5;        // Passes; each one doubles the footprint
+  double sigma_colour = 4;   // Colour difference, in noise standard deviations
+  double sigma_normal = 0.3; // Difference of normals
+  double sigma_albedo = 0.1; // Difference of albedos
+  int num_threads = 0;       // Filter threads (0 uses every hardware thread)
+};
+
+// Filters the pixel means of image, which must have features, with the
+// edge-avoiding a-trous wavelet transform (Dammertz et al., "Edge-Avoiding
+// A-Trous Wavelet Transform for fast Global Illumination Filtering", 2010):
+// passes of a 5x5 B-spline kernel whose taps are spread 1, 2, 4, ... pixels
+// apart, each tap weighted down by how much its pixel's colour, normal and
+// albedo differ from those of the centre. Colours are compared against the
+// noise of the centre pixel, estimated from its neighbours of like features
+// and carried through the passes, as in SVGF (Schied et al., 2017). Returns
+// an image of the same size with one sample per pixel.
+framebuffer denoise(const framebuffer &image, const denoise_settings &settings);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef FD_IO_H
+#define FD_IO_H
+
+#include <cstddef>
+
+// Transfer exactly size bytes from or to a file descriptor, retrying after
+// signals and short transfers. False at the end of the file or on an error,
+// which leaves the reason in errno.
+bool read_all(const int fd, void *data, std::size_t size);
+bool write_all(const int fd, const void *data, std::size_t size);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "colour.hpp"
+#include "rtweekend.hpp"
+
+#include <vector>
+
+// Linear (not gamma corrected) radiance of every pixel of an image, kept as
+// the sum of all samples taken so far and their count. Rows are stored top to
+// bottom.
+class framebuffer {
+public:
+  framebuffer();
+  framebuffer(const int width, const int height);
+
+  int width() const;
+  int height() const;
+
+  // Adds count samples whose colours sum to sum to pixel (x, y).
+  void add_samples(const int x, const int y, const colour &sum,
+                   const int count);
+
+  // Mean of the samples of pixel (x, y), black if it has none.
+  colour pixel(const int x, const int y) const;
+
+  int samples(const int x, const int y) const;
+
+  // Sum of the samples of pixel (x, y).
+  colour sum(const int x, const int y) const;
+
+  // Replaces the samples of pixel (x, y) with count samples summing to sum.
+  void set_samples(const int x, const int y, const colour &sum,
+                   const int count);
+
+  // Per-pixel render time, only kept after enable_costs(). Threads may add to
+  // disjoint pixels concurrently, but enable_costs() must come first.
+  void enable_costs();
+  bool has_costs() const;
+  void add_cost(const int x, const int y, const double seconds);
+  double cost(const int x, const int y) const; // 0 without costs
+
+  // Mean albedo and normal of the first surface seen through each pixel,
+  // only kept after enable_features(); the denoiser follows their edges.
+  // Like costs, threads may set disjoint pixels concurrently.
+  void enable_features();
+  bool has_features() const;
+  void set_features(const int x, const int y, const colour &albedo,
+                    const vec3 &normal);
+  colour albedo(const int x, const int y) const; // Black without features
+  vec3 normal(const int x, const int y) const;   // Zero without features
+
+private:
+  int image_width = 0;
+  int image_height = 0;
+  std::vector<colour> sums;
+  std::vector<int> counts;
+  std::vector<double> costs;
+  std::vector<colour> albedos;
+  std::vector<vec3> normals;
+
+  std::size_t index(const int x, const int y) const;
+};
+
+// An image of the same size whose pixels show how many samples each pixel of
+// image received, from blue (fewest) through green and yellow to red (most).
+framebuffer sample_heatmap(const framebuffer &image);
+
+// The same for the render time of each pixel of image, which must have costs.
+// Times span orders of magnitude, so the scale is logarithmic.
+framebuffer cost_heatmap(const framebuffer &image);
+
+// The albedo and normal features of image, which must have them, as images;
+// normals are mapped from [-1, 1] to [0, 1].
+framebuffer albedo_map(const framebuffer &image);
+framebuffer normal_map(const framebuffer &image);
+
+// Colour of t in [0, 1] on the blue-green-yellow-red scale used by heatmaps.
+colour heatmap_colour(const double t);
+
+#endif
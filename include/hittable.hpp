@@ -1,29 +1,84 @@
 #ifndef HITTABLE_H
 #define HITTABLE_H
 
+#include "aabb.hpp"
 #include "ray.hpp"
+#include "ray_packet.hpp"
 #include "rtweekend.hpp"
 #include "vec3.hpp"
 
-class material;
+#include <cstdint>
+
 class interval;
 
+// Index of a material in the scene's material_table.
+using material_id = std::uint32_t;
+
 class hit_record {
 public:
   point3 p;
   vec3 normal;
-  std::shared_ptr<material> mat;
-  double t;
+  material_id mat;
+  real t;
   bool front_face;
+  real error; // Bound on the distance of p from the true surface
 
   void set_face_normal(const ray &r, const vec3 &outward_normal);
+
+  // Origin for a ray leaving the surface along direction: p moved by the
+  // error bound to the side the ray leaves on, so that the ray cannot hit the
+  // surface again at its start.
+  point3 spawn_origin(const vec3 &direction) const;
+};
+
+// Error bound for a hit point projected onto a surface whose coordinates are
+// at most magnitude in size. It scales with the precision of real, so that
+// float builds move rays off surfaces further than double builds.
+CONSTEXPR_OR_INLINE real surface_error(const real magnitude) {
+  return 4 * std::numeric_limits<real>::epsilon() * magnitude;
+}
+
+class hittable;
+
+// The closest hit found so far by intersect(): just enough to fill in the
+// hit_record later, once no closer hit can replace it.
+class hit_candidate {
+public:
+  real t;
+  const hittable *object; // Primitive that was hit
+  int primitive;          // Index of the hit primitive within object
 };
 
 class hittable {
 public:
   virtual ~hittable() = default;
 
-  virtual bool hit(const ray &r, interval ray_t, hit_record &rec) const = 0;
+  // Closest hit in ray_t with the surface data filled in; intersect()
+  // followed by finalize() of the object that was hit.
+  bool hit(const ray &r, interval ray_t, hit_record &rec) const;
+
+  // Closest hit in ray_t, without computing any surface data. Composite
+  // objects report the primitive that was hit, not themselves.
+  virtual bool intersect(const ray &r, interval ray_t,
+                         hit_candidate &hit) const = 0;
+
+  // Whether anything lies along r within ray_t, for shadow rays. Unlike
+  // intersect() it may stop at the first hit it finds, in any order, and
+  // keeps nothing of it. The default runs intersect().
+  virtual bool occluded(const ray &r, interval ray_t) const;
+
+  // Fills in rec for a hit that intersect() reported on this object.
+  virtual void finalize(const ray &r, const hit_candidate &hit,
+                        hit_record &rec) const = 0;
+
+  // Closest-hit query for every active lane of a packet. Lanes that find a
+  // hit closer than their t_max get it in hits[lane] and have t_max lowered
+  // to it; the returned mask marks those lanes. The default traces each lane
+  // on its own.
+  virtual unsigned intersect_packet(ray_packet &packet,
+                                    hit_candidate *hits) const;
+
+  virtual aabb bounding_box() const = 0;
 };
 
 #endif
\ No newline at end of file
@@ -10,15 +10,39 @@
 
 class hittable_list : public hittable {
 public:
-  std::vector<std::shared_ptr<hittable>> objects;
+  std::vector<const hittable *> objects;
 
   hittable_list();
   hittable_list(std::shared_ptr<hittable> object);
   void clear();
 
+  // Adds object and shares in its ownership.
   void add(std::shared_ptr<hittable> object);
 
-  bool hit(const ray &r, interval ray_t, hit_record &rec) const override;
+  // Adds an object the list does not own, such as one made in a scene's
+  // arena; it has to outlive the list.
+  void add(const hittable *object);
+
+  // The objects added by shared_ptr.
+  const std::vector<std::shared_ptr<const hittable>> &owned() const;
+
+  bool intersect(const ray &r, interval ray_t,
+                 hit_candidate &hit) const override;
+
+  bool occluded(const ray &r, interval ray_t) const override;
+
+  // Forwards to the object that was hit.
+  void finalize(const ray &r, const hit_candidate &hit,
+                hit_record &rec) const override;
+
+  unsigned intersect_packet(ray_packet &packet,
+                            hit_candidate *hits) const override;
+
+  aabb bounding_box() const override;
+
+private:
+  std::vector<std::shared_ptr<const hittable>> owners;
+  aabb bbox;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "framebuffer.hpp"
+
+#include <cstddef>
+#include <string>
+
+// File formats a framebuffer can be encoded in.
+enum class image_format {
+  p3,  // ASCII PPM, 8 bits per channel, gamma 2
+  p6,  // Binary PPM, 8 bits per channel, gamma 2
+  pfm, // Portable float map, 32-bit linear radiance
+};
+
+// Parses a format name ("p3", "p6" or "pfm"); returns false if unknown.
+bool parse_image_format(const std::string &name, image_format &format);
+
+// Number of bytes encode_image() writes for image.
+std::size_t encoded_size(const framebuffer &image, const image_format format);
+
+// Encodes image into out, which must hold encoded_size() bytes.
+void encode_image(const framebuffer &image, const image_format format,
+                  char *out);
+
+// Encodes image and writes it to the file at path, or to standard output if
+// path is "-". With use_mmap the file is sized up front and the image is
+// encoded straight into a mapping of it. Returns false and prints the reason
+// to std::cerr if the file cannot be written.
+bool write_image(const framebuffer &image, const image_format format,
+                 const std::string &path, const bool use_mmap);
+
+// Writes image like write_image(), but to a temporary file next to path that
+// is then renamed over it, so that readers of path only ever see a whole
+// image. To standard output ("-") it writes one more image after those
+// before, making a stream of frames.
+bool replace_image(const framebuffer &image, const image_format format,
+                   const std::string &path);
+
+#endif
@@ -5,19 +5,22 @@
 
 class interval {
 public:
-  double min, max;
+  real min, max;
 
   interval();
 
-  interval(const double min, const double max);
+  interval(const real min, const real max);
 
-  double size() const;
+  // The tightest interval enclosing both a and b.
+  interval(const interval &a, const interval &b);
 
-  bool contains(const double x) const;
+  real size() const;
 
-  bool surrounds(const double x) const;
+  bool contains(const real x) const;
 
-  double clamp(const double x) const;
+  bool surrounds(const real x) const;
+
+  real clamp(const real x) const;
 };
 
 #endif
\ No newline at end of file
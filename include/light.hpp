@@ -0,0 +1,81 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "colour.hpp"
+#include "hittable.hpp"
+#include "material.hpp"
+#include "rtweekend.hpp"
+#include "sampler.hpp"
+#include "vec3.hpp"
+
+#include <vector>
+
+// A direction towards a light, picked by light_list::sample().
+class light_sample {
+public:
+  vec3 direction;  // Unit vector from the shading point
+  double distance; // Along direction to just short of the light's surface
+  colour emission; // Radiance the light sends back along direction
+  double pdf;      // Density per solid angle, the choice of light included
+};
+
+// The spheres of a scene whose material emits light. sample() picks one of
+// them uniformly, then a direction uniformly over the cone the sphere fills
+// as seen from the shading point, so every direction reaches the light.
+class light_list {
+public:
+  void add(const point3 &center, const real radius, const material_id mat,
+           const colour &emission);
+
+  void clear();
+
+  bool empty() const;
+
+  std::size_t size() const;
+
+  // Picks a light with choice and a direction towards it with u, both in
+  // [0, 1). Returns false if p is inside the chosen light.
+  bool sample(const point3 &p, const double choice, const sample_2d &u,
+              light_sample &result) const;
+
+  // Density with which sample() picks the direction from p to rec, a hit on
+  // one of the lights; 0 if rec is on none of them.
+  double pdf(const point3 &p, const hit_record &rec) const;
+
+private:
+  class sphere_light {
+  public:
+    point3 center;
+    real radius;
+    material_id mat;
+    colour emission;
+  };
+
+  std::vector<sphere_light> lights;
+
+  // Density of the cone light l fills as seen from p, 0 inside l.
+  static double cone_pdf(const sphere_light &l, const point3 &p);
+};
+
+// Power heuristic weight of a sampling strategy with density pdf that is
+// combined with one with density other_pdf.
+double power_heuristic(const double pdf, const double other_pdf);
+
+// Next-event estimation at rec, whose material mat is diffuse(): light from
+// one light sample (drawn from gen's light dimensions) reaching the viewer,
+// weighted against mat.scatter() finding the same light. Traces a shadow
+// ray into world.
+colour sample_direct_light(const hittable &world, const light_list &lights,
+                           const material &mat, const hit_record &rec,
+                           sampler &gen);
+
+// Light emitted at rec towards a ray that was scattered at `from` with
+// density scatter_pdf, weighted against sample_direct_light() at `from`
+// picking the same point. scatter_pdf is 0 where no light was sampled (for
+// camera rays and after bounces off materials that are not diffuse()), which
+// leaves the emission unweighted.
+colour emitted_light(const light_list &lights, const material &mat,
+                     const hit_record &rec, const point3 &from,
+                     const double scatter_pdf);
+
+#endif
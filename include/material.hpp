@@ -4,48 +4,53 @@
 #include "colour.hpp"
 #include "hittable.hpp"
 #include "rtweekend.hpp"
+#include "sampler.hpp"
 
-class material {
-public:
-  virtual ~material() = default;
-
-  virtual bool scatter(const ray &r_in [[maybe_unused]],
-                       const hit_record &rec [[maybe_unused]],
-                       colour &attenuation [[maybe_unused]],
-                       ray &scattered [[maybe_unused]]) const;
-};
+#include <vector>
 
-class lambertian : public material {
+class lambertian {
 public:
   lambertian(const colour &albedo);
 
   bool scatter(const ray &r_in [[maybe_unused]], const hit_record &rec,
-               colour &attenuation, ray &scattered) const override;
+               colour &attenuation, ray &scattered, sampler &gen) const;
+
+  // Light scattered towards the viewer from unit direction, relative to the
+  // light arriving, times the cosine at the surface; pdf is the density
+  // (per solid angle) with which scatter() picks direction.
+  colour evaluate(const hit_record &rec, const vec3 &direction,
+                  double &pdf) const;
 
 private:
+  friend class material;
+
   colour albedo;
 };
 
-class metal : public material {
+class metal {
 public:
   metal(const colour &albedo, double fuzz);
 
   bool scatter(const ray &r_in, const hit_record &rec, colour &attenuation,
-               ray &scattered) const override;
+               ray &scattered, sampler &gen) const;
 
 private:
+  friend class material;
+
   colour albedo;
   double fuzz;
 };
 
-class dielectric : public material {
+class dielectric {
 public:
   dielectric(double refraction_index);
 
   bool scatter(const ray &r_in, const hit_record &rec, colour &attenuation,
-               ray &scattered) const override;
+               ray &scattered, sampler &gen) const;
 
 private:
+  friend class material;
+
   // Refractive index in vacuum or air, or the ratio of the material's
   // refractive index over the refractive index of the enclosing media
   double refraction_index;
@@ -53,4 +58,110 @@ private:
   static double reflectance(const double cosine, const double refraction_index);
 };
 
-#endif
\ No newline at end of file
+// Emits light from the front of its surface and absorbs whatever reaches it.
+class diffuse_light {
+public:
+  diffuse_light(const colour &emit);
+
+  bool scatter(const ray &r_in, const hit_record &rec, colour &attenuation,
+               ray &scattered, sampler &gen) const;
+
+private:
+  friend class material;
+
+  colour emit; // Radiance leaving the surface
+};
+
+// Tag of the concrete class held by a material.
+enum class material_kind { lambertian, metal, dielectric, diffuse_light };
+
+// The parameters of a material as plain numbers, the form in which scene files
+// store it: lambertian albedo (r, g, b); metal albedo (r, g, b) and fuzz;
+// dielectric refraction index; diffuse_light emitted radiance (r, g, b).
+// Unused values are 0.
+class material_params {
+public:
+  material_kind kind;
+  double values[4];
+};
+
+// One of the concrete material classes above, stored by value next to a tag.
+// scatter() dispatches with a switch on the tag rather than through a vtable,
+// and materials can be kept in a flat array.
+class material {
+public:
+  material(const lambertian &mat);
+  material(const metal &mat);
+  material(const dielectric &mat);
+  material(const diffuse_light &mat);
+  material(const material_params &params);
+
+  material_kind kind() const;
+
+  material_params params() const;
+
+  bool scatter(const ray &r_in, const hit_record &rec, colour &attenuation,
+               ray &scattered, sampler &gen) const;
+
+  // Radiance leaving the front of the surface: black but for diffuse_light.
+  colour emission() const;
+
+  // Fraction of the light arriving that the surface sends on, as a feature
+  // for denoising: the albedo of lambertian and metal, white for dielectric
+  // and diffuse_light.
+  colour albedo() const;
+
+  // Whether evaluate() describes how the material scatters, which sampling
+  // the lights needs. Only lambertian does: metal and dielectric send light
+  // into (nearly) single directions that a light sample would never pick.
+  bool diffuse() const;
+
+  // As lambertian::evaluate(); black with pdf 0 unless diffuse().
+  colour evaluate(const hit_record &rec, const vec3 &direction,
+                  double &pdf) const;
+
+  // The held material; mat_type must match kind().
+  template <class mat_type> const mat_type &as() const;
+
+private:
+  material_kind tag;
+  union {
+    lambertian lambertian_mat;
+    metal metal_mat;
+    dielectric dielectric_mat;
+    diffuse_light diffuse_light_mat;
+  };
+};
+
+template <> inline const lambertian &material::as<lambertian>() const {
+  return lambertian_mat;
+}
+
+template <> inline const metal &material::as<metal>() const {
+  return metal_mat;
+}
+
+template <> inline const dielectric &material::as<dielectric>() const {
+  return dielectric_mat;
+}
+
+template <>
+inline const diffuse_light &material::as<diffuse_light>() const {
+  return diffuse_light_mat;
+}
+
+// Every material of a scene, addressed by the material_id stored in hit
+// records and primitives.
+class material_table {
+public:
+  material_id add(const material &mat);
+
+  const material &operator[](const material_id id) const;
+
+  std::size_t size() const;
+
+private:
+  std::vector<material> materials;
+};
+
+#endif
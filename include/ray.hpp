@@ -15,7 +15,7 @@ public:
   const vec3 &direction() const;
   vec3 &direction();
 
-  point3 at(const double t) const;
+  point3 at(const real t) const;
 
 private:
   point3 orig;
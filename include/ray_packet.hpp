@@ -0,0 +1,28 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "ray.hpp"
+#include "rtweekend.hpp"
+#include "vec3.hpp"
+
+// A bundle of coherent rays traced together, stored as a structure of arrays
+// so that per-lane loops vectorise. Only lanes whose bit is set in `active`
+// carry a ray; t_max shrinks per lane as closer hits are found. Inactive lanes
+// hold zeros, since intersection tests run across every lane and mask after.
+class ray_packet {
+public:
+  static constexpr int size = 8;
+  static constexpr unsigned all_lanes = (1u << size) - 1;
+
+  real origin_x[size] = {}, origin_y[size] = {}, origin_z[size] = {};
+  real direction_x[size] = {}, direction_y[size] = {}, direction_z[size] = {};
+  real t_min = 0;
+  real t_max[size] = {};
+  unsigned active = 0;
+
+  void set(const int lane, const ray &r, const real t_max);
+
+  ray get(const int lane) const;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include "material.hpp"
+#include "rtweekend.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Primitive types whose intersection tests are counted separately.
+enum class primitive_kind { sphere, sphere_set };
+
+// Work done rendering one tile. The time and samples are recorded in every
+// build, the rays only with ENABLE_STATS.
+class tile_time {
+public:
+  int x0, y0, x1, y1;    // Pixels [x0, x1) x [y0, y1)
+  int thread;            // Thread that rendered the tile
+  double seconds;        // Wall time
+  std::uint64_t samples; // Samples taken over all pixels of the tile
+  std::uint64_t rays;    // Rays traced into the world
+};
+
+// Counters of the work done while rendering. Each thread counts into its own
+// copy, so counting needs no synchronisation; the camera sums the copies.
+// The counters are only updated when built with ENABLE_STATS, and the
+// STATS_ADD calls compile to nothing otherwise; tiles are always recorded.
+class render_stats {
+public:
+  // Rays deeper than this are counted with the deepest tracked bounce.
+  static constexpr int depth_buckets = 64;
+  static constexpr int num_primitive_kinds = 2;
+  static constexpr int num_material_kinds = 4;
+
+  // Rays traced into the world, by bounce (0 for camera rays).
+  std::uint64_t rays_by_depth[depth_buckets] = {};
+
+  // Shadow rays towards light samples, and those that something blocked.
+  std::uint64_t shadow_rays = 0;
+  std::uint64_t shadow_rays_occluded = 0;
+
+  // Ray-primitive intersection tests, and the tests that found a hit closer
+  // than the ray's current range, by primitive_kind.
+  std::uint64_t tests[num_primitive_kinds] = {};
+  std::uint64_t hits[num_primitive_kinds] = {};
+  std::uint64_t finalizations = 0; // Hit records filled in by finalize()
+
+  // scatter() calls, and those that absorbed the ray, by material_kind.
+  std::uint64_t scatters[num_material_kinds] = {};
+  std::uint64_t absorptions[num_material_kinds] = {};
+
+  // How paths ended.
+  std::uint64_t paths_escaped = 0;   // Missed the world
+  std::uint64_t paths_absorbed = 0;  // A material absorbed the ray
+  std::uint64_t paths_max_depth = 0; // Reached max_depth bounces
+  std::uint64_t paths_roulette = 0;  // Ended by Russian roulette
+
+  std::vector<tile_time> tiles; // In order of completion
+
+  // Set by the camera for the whole render.
+  int threads = 0;
+  double seconds = 0;
+
+  render_stats &operator+=(const render_stats &other);
+
+  // Every counter above, in declaration order, as one flat array, for
+  // sending the counters of another process.
+  static constexpr int num_counters = depth_buckets + 2 +
+                                      2 * num_primitive_kinds + 1 +
+                                      2 * num_material_kinds + 4;
+  void copy_counters(std::uint64_t *out) const;
+  void add_counters(const std::uint64_t *in);
+
+  // Rays traced into the world, shadow rays included.
+  std::uint64_t rays() const;
+
+  // Short human readable summary.
+  void print(std::ostream &out) const;
+
+  // Every counter as a JSON object.
+  void write_json(std::ostream &out) const;
+
+  // One line per tile, in image order, with a header line.
+  void write_tile_csv(std::ostream &out) const;
+
+  static int depth_bucket(const int depth);
+
+  // Counters of the calling thread.
+  static render_stats &local();
+
+private:
+  std::vector<tile_time> tiles_in_image_order() const;
+};
+
+// Wall time from start until now, for the times recorded while rendering.
+inline double seconds_since(const std::chrono::steady_clock::time_point start) {
+  CONST_VAR std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+#if ENABLE_STATS
+#define STATS_ADD(counter, n) (render_stats::local().counter += (n))
+#else
+// Unevaluated, but keeps the arguments used.
+#define STATS_ADD(counter, n)                                                \
+  ((void)sizeof(render_stats::local().counter += (n)))
+#endif
+
+#endif
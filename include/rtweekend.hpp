@@ -2,10 +2,10 @@
 #define RTWEEKEND_H
 
 #include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <limits>
 #include <memory>
-#include <random>
 
 // Common Macros
 
@@ -43,6 +43,14 @@
 #define CONSTEXPR
 #endif
 
+// Scalar type of points, directions, ray parameters and colours: double, or
+// float when built with ENABLE_FLOAT.
+#if ENABLE_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 // Constants
 constexpr double pi = 3.1415926535897932385;
 
@@ -52,15 +60,49 @@ CONSTEXPR_OR_INLINE double degrees_to_radians(const double degrees) {
   return degrees * pi / 180.0;
 }
 
-inline double random_double() {
-  static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-  static std::mt19937 generator;
-  return distribution(generator);
+// A small counter-based random number generator (SplitMix64). Its whole state
+// is a single counter, so a generator can be created on the fly for any pixel
+// and sample; renders then do not depend on thread count or tile order.
+class rng {
+public:
+  CONSTEXPR explicit rng(const std::uint64_t seed = 0) : state(seed) {}
+
+  // Independent stream for one camera sample of one pixel.
+  static CONSTEXPR rng for_sample(const std::uint64_t pixel,
+                                  const std::uint64_t sample) {
+    return rng(mix(mix(pixel + golden_gamma) ^ (sample * golden_gamma)));
+  }
+
+  CONSTEXPR std::uint64_t next_u64() {
+    state += golden_gamma;
+    return mix(state);
+  }
+
+  // Returns a random real in [0,1) with 53 bits of resolution.
+  CONSTEXPR double next_double() {
+    return double(next_u64() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+private:
+  static constexpr std::uint64_t golden_gamma = 0x9e3779b97f4a7c15ULL;
+
+  std::uint64_t state;
+
+  static CONSTEXPR std::uint64_t mix(std::uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+};
+
+inline double random_double(rng &gen) {
+  // Returns a random real in [0,1).
+  return gen.next_double();
 }
 
-inline double random_double(const double min, const double max) {
+inline double random_double(rng &gen, const double min, const double max) {
   // Returns a random real in [min,max).
-  return min + (max - min) * random_double();
+  return min + (max - min) * random_double(gen);
 }
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef RUSSIAN_ROULETTE_H
+#define RUSSIAN_ROULETTE_H
+
+#include "colour.hpp"
+#include "rtweekend.hpp"
+#include "sampler.hpp"
+
+// Paths whose largest throughput component is at least this always survive
+// Russian roulette. Playing roulette with the raw throughput instead (as if
+// this were 1) ends more paths, but the survivors' weights grow so much that
+// the added noise costs more than the rays saved.
+constexpr double roulette_threshold = 0.1;
+
+// Russian roulette for a path that has made `bounces` bounces and carries
+// `throughput`. Once at least min_bounces have been made (never if
+// min_bounces is negative), a path whose largest throughput component t is
+// below roulette_threshold survives with probability t / roulette_threshold.
+// A surviving path has its throughput divided by that probability, which
+// keeps the estimate unbiased. Returns false if the path ends.
+inline bool survives_roulette(colour &throughput, const int bounces,
+                              const int min_bounces, sampler &gen) {
+  if (min_bounces < 0 || bounces < min_bounces)
+    return true;
+  CONST_VAR double survival =
+      std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())) /
+      roulette_threshold;
+  if (survival >= 1)
+    return true;
+  if (gen.roulette_1d() >= survival)
+    return false;
+  throughput /= survival;
+  return true;
+}
+
+#endif
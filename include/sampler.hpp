@@ -0,0 +1,83 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rtweekend.hpp"
+
+#include <cstdint>
+#include <string>
+
+// Point sets a sampler draws from. All of them give every pixel its own
+// randomisation, so neighbouring pixels do not share error patterns.
+enum class sample_pattern {
+  random,     // Independent uniform random numbers
+  stratified, // One jittered point per stratum, strata shuffled per dimension
+  halton,     // Halton sequence, digits shuffled per pixel and dimension
+  sobol,      // Sobol (0,2)-sequence, Owen scrambled and shuffled per pair
+              // of dimensions
+};
+
+// Parses a pattern name ("random", "stratified", "halton" or "sobol");
+// returns false if unknown.
+bool parse_sample_pattern(const std::string &name, sample_pattern &pattern);
+
+// A point of the unit square.
+class sample_2d {
+public:
+  double u, v;
+};
+
+// The numbers in [0, 1) of one sample of one pixel. Dimension d of sample s
+// is the same wherever it is asked for, so a sample can be taken again (or
+// resumed) by index. Dimensions are laid out so that each use gets the same
+// dimension in every sample, which is what lets the low-discrepancy patterns
+// stratify it: the camera takes the first camera_dimensions and every bounce
+// bounce_dimensions after that.
+class sampler {
+public:
+  // Position in the pixel and on the lens.
+  static constexpr int camera_dimensions = 4;
+  // Up to three for the material's scatter, one for Russian roulette, two
+  // for the direction of a light sample and one to choose its light.
+  static constexpr int bounce_dimensions = 8;
+
+  // Placeholder for arrays of samplers; assign a real sampler before use.
+  sampler();
+
+  // samples_per_pixel is the number of samples the pixel takes: the
+  // stratified pattern spreads them over its strata and the Halton pattern
+  // shuffles the digits they differ in. The other patterns ignore it, and
+  // their samples are the same whatever it is.
+  sampler(const sample_pattern pattern, const std::uint64_t pixel,
+          const std::uint32_t sample, const std::uint32_t samples_per_pixel);
+
+  // The next one or two dimensions.
+  double next_1d();
+  sample_2d next_2d();
+
+  // Moves to the dimensions of bounce `bounce`, 1 for the first surface hit.
+  void start_bounce(const int bounce);
+
+  // The Russian roulette dimension of the current bounce.
+  double roulette_1d() const;
+
+  // The light sampling dimensions of the current bounce: a direction and a
+  // choice of light.
+  sample_2d light_2d() const;
+  double light_1d() const;
+
+private:
+  sample_pattern pattern;
+  std::uint32_t sample;
+  std::uint32_t samples_per_pixel;
+  int dimension = 0;    // Next dimension next_1d() returns
+  int bounce_start = 0; // First dimension of the current bounce
+  std::uint64_t seed;   // Randomisation of this pixel
+
+  double get_1d(const int dimension) const;
+  sample_2d get_2d(const int dimension) const;
+
+  // The sobol point of dimensions 2 * pair and 2 * pair + 1.
+  sample_2d sobol_pair(const int pair) const;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "camera.hpp"
+#include "scenes.hpp"
+
+#include <string>
+
+// Scene files hold the settings of a camera, a table of materials and a list
+// of spheres, in one of two forms.
+//
+// Text: one directive per line, '#' starts a comment.
+//   camera <field> <value>...     any public setting of camera but the
+//                                 checkpoint ones and sampling, e.g.
+//                                 "camera image_width 1200" or
+//                                 "camera lookfrom 13 2 3"
+//   material <name> lambertian <r> <g> <b>
+//   material <name> metal <r> <g> <b> <fuzz>
+//   material <name> dielectric <refraction index>
+//   material <name> diffuse_light <r> <g> <b>
+//   sphere <x> <y> <z> <radius> <material name>
+//
+// Binary: a header, the camera settings and the materials, then the spheres
+// as one array per coordinate, radius and material index, each 64-byte
+// aligned and in native byte order. The file is memory mapped and, if it was
+// written with the same precision as real, the spheres are read straight out
+// of the mapping with no per-sphere work.
+
+// Reads the scene file at path, text or binary (told apart by the binary
+// header), into cam and result; the world is left for
+// scene::build_world(). Camera settings the file does not give keep their
+// values. Returns false and prints the reason to std::cerr on failure.
+bool load_scene(const std::string &path, camera &cam, scene &result);
+
+// Writes the settings of cam and the materials and spheres of s. Returns
+// false and prints the reason to std::cerr on failure.
+bool save_scene_text(const std::string &path, const camera &cam,
+                     const scene &s);
+bool save_scene_binary(const std::string &path, const camera &cam,
+                       const scene &s);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "arena.hpp"
+#include "camera.hpp"
+#include "hittable_list.hpp"
+#include "light.hpp"
+#include "material.hpp"
+#include "sphere_set.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// A world and the materials its primitives refer to.
+class scene {
+public:
+  // Holds the objects build_world() makes for world, side by side in memory
+  // and without reference counts; declared first so that it outlives world.
+  arena objects;
+  hittable_list world;
+  material_table materials;
+  // The spheres with emitting materials; build_world() collects them.
+  light_list lights;
+
+  // Every sphere of the scene, the form in which scene files store them;
+  // build_world() makes world from them.
+  std::shared_ptr<sphere_set> spheres = std::make_shared<sphere_set>();
+
+  // Replaces world with the spheres, held as accel: "bvh" (a bvh_node over
+  // one sphere object each), "list" (the sphere objects) or "sphere_set"
+  // (the set itself).
+  void build_world(const std::string &accel);
+};
+
+// The final scene of Ray Tracing in One Weekend: a ground sphere, three large
+// spheres and a grid of small random ones. accel selects how the spheres are
+// held: "bvh", "list" or "sphere_set". The same seed gives the same scene.
+scene random_spheres_scene(const std::string &accel,
+                           const std::uint64_t seed = 0);
+
+// Points cam at random_spheres_scene() the way the book does.
+void set_random_spheres_view(camera &cam);
+
+#endif
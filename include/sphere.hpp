@@ -8,15 +8,27 @@
 
 class sphere : public hittable {
 public:
-  sphere(const point3 &center, const double radius,
-         std::shared_ptr<material> mat);
+  sphere(const point3 &center, const real radius,
+         const material_id mat);
 
-  bool hit(const ray &r, interval ray_t, hit_record &rec) const override;
+  bool intersect(const ray &r, interval ray_t,
+                 hit_candidate &hit) const override;
+
+  bool occluded(const ray &r, interval ray_t) const override;
+
+  void finalize(const ray &r, const hit_candidate &hit,
+                hit_record &rec) const override;
+
+  unsigned intersect_packet(ray_packet &packet,
+                            hit_candidate *hits) const override;
+
+  aabb bounding_box() const override;
 
 private:
   point3 center;
-  double radius;
-  std::shared_ptr<material> mat;
+  real radius;
+  material_id mat;
+  aabb bbox;
 };
 
 #endif
\ No newline at end of file
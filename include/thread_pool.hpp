@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that execute batches of indexed tasks. Each
+// thread owns a queue of task indices; a thread that runs out of work steals
+// from the back of another thread's queue, so uneven task costs still keep
+// every thread busy.
+class thread_pool {
+public:
+  explicit thread_pool(int num_threads);
+  ~thread_pool();
+
+  thread_pool(const thread_pool &) = delete;
+  thread_pool &operator=(const thread_pool &) = delete;
+
+  int size() const;
+
+  // Calls task(thread_id, index) for every index in [0, count) and returns
+  // once all of them have completed. The calling thread takes part as
+  // thread 0.
+  void parallel_for(int count, const std::function<void(int, int)> &task);
+
+  // Number of threads to use when the user does not ask for a count.
+  static int default_threads();
+
+private:
+  class work_queue {
+  public:
+    std::mutex lock;
+    std::deque<int> items;
+  };
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<work_queue>> queues;
+
+  std::mutex state_lock;
+  std::condition_variable wake;
+  std::condition_variable finished;
+  const std::function<void(int, int)> *current_task = nullptr;
+  std::uint64_t generation = 0;
+  int active_workers = 0;
+  bool stopping = false;
+
+  void worker_loop(const int thread_id);
+  void run_tasks(const int thread_id);
+  bool pop_task(const int thread_id, int &index);
+  bool steal_task(const int thread_id, int &index);
+};
+
+#endif
@@ -6,38 +6,74 @@
 
 #include "rtweekend.hpp"
 
+// With ENABLE_SIMD_VEC3, a vec3 is four lanes of real in a GCC/Clang vector,
+// the fourth always zero, so that its operators are single SIMD instructions
+// on any target the compiler vectorises for (SSE2, AVX, NEON). Vectors cannot
+// be used in constant expressions, so those operators are inline rather than
+// constexpr. The alignment is capped at 16 bytes, which is what the heap
+// guarantees in C++14; double lanes with AVX are then loaded unaligned.
+#if ENABLE_SIMD_VEC3
+typedef real real4
+    __attribute__((vector_size(4 * sizeof(real)), aligned(16)));
+#define VEC3_CONSTEXPR
+#define VEC3_CONSTEXPR_OR_INLINE inline
+#else
+#define VEC3_CONSTEXPR CONSTEXPR
+#define VEC3_CONSTEXPR_OR_INLINE CONSTEXPR_OR_INLINE
+#endif
+
 class vec3 {
 public:
-  double e[3];
+#if ENABLE_SIMD_VEC3
+  union {
+    real4 v;
+    real e[4];
+  };
+
+  explicit vec3(const real4 v) : v(v) {}
+  vec3(real e0, real e1, real e2) : v{e0, e1, e2, 0} {}
+#else
+  real e[3];
+
+  CONSTEXPR vec3(real e0, real e1, real e2) : e{e0, e1, e2} {}
+#endif
 
   vec3();
-  CONSTEXPR vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
 
-  CONSTEXPR double x() const { return e[0]; }
-  CONSTEXPR double y() const { return e[1]; }
-  CONSTEXPR double z() const { return e[2]; }
+  VEC3_CONSTEXPR real x() const { return e[0]; }
+  VEC3_CONSTEXPR real y() const { return e[1]; }
+  VEC3_CONSTEXPR real z() const { return e[2]; }
 
+#if ENABLE_SIMD_VEC3
+  vec3 operator-() const { return vec3(-v); }
+#else
   CONSTEXPR vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-  CONSTEXPR double operator[](const int i) const { return e[i]; }
-  double &operator[](const int i);
+#endif
+  VEC3_CONSTEXPR real operator[](const int i) const { return e[i]; }
+  real &operator[](const int i);
 
   vec3 &operator+=(const vec3 &v);
 
-  vec3 &operator*=(double t);
+  vec3 &operator*=(real t);
 
-  vec3 &operator/=(double t);
+  vec3 &operator/=(real t);
 
-  CONSTEXPR double length() const { return std::sqrt(length_squared()); }
+  VEC3_CONSTEXPR real length() const { return std::sqrt(length_squared()); }
 
-  CONSTEXPR double length_squared() const {
+  VEC3_CONSTEXPR real length_squared() const {
+#if ENABLE_SIMD_VEC3
+    CONST_VAR real4 squares = v * v;
+    return squares[0] + squares[1] + squares[2];
+#else
     return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+#endif
   }
 
   bool near_zero() const;
 
-  static vec3 random();
+  static vec3 random(rng &gen);
 
-  static vec3 random(const double min, const double max);
+  static vec3 random(rng &gen, const real min, const real max);
 };
 
 // point3 is just an alias for vec3, but useful for geometric clarity in the
@@ -50,6 +86,32 @@ inline std::ostream &operator<<(std::ostream &out, const vec3 &v) {
   return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
+#if ENABLE_SIMD_VEC3
+
+inline vec3 operator+(const vec3 &u, const vec3 &v) { return vec3(u.v + v.v); }
+
+inline vec3 operator-(const vec3 &u, const vec3 &v) { return vec3(u.v - v.v); }
+
+inline vec3 operator*(const vec3 &u, const vec3 &v) { return vec3(u.v * v.v); }
+
+inline vec3 operator*(const real t, const vec3 &v) { return vec3(t * v.v); }
+
+inline real dot(const vec3 &u, const vec3 &v) {
+  CONST_VAR real4 products = u.v * v.v;
+  return products[0] + products[1] + products[2];
+}
+
+inline vec3 cross(const vec3 &u, const vec3 &v) {
+  // u x v = (u * v.yzx - u.yzx * v).yzx; compilers turn each rotation of the
+  // lanes into a single shuffle.
+  CONST_VAR real4 u_yzx = {u.e[1], u.e[2], u.e[0], 0};
+  CONST_VAR real4 v_yzx = {v.e[1], v.e[2], v.e[0], 0};
+  CONST_VAR real4 w = u.v * v_yzx - u_yzx * v.v;
+  return vec3(real4{w[1], w[2], w[0], 0});
+}
+
+#else
+
 CONSTEXPR_OR_INLINE vec3 operator+(const vec3 &u, const vec3 &v) {
   return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
@@ -62,19 +124,11 @@ CONSTEXPR_OR_INLINE vec3 operator*(const vec3 &u, const vec3 &v) {
   return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-CONSTEXPR_OR_INLINE vec3 operator*(const double t, const vec3 &v) {
+CONSTEXPR_OR_INLINE vec3 operator*(const real t, const vec3 &v) {
   return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
 }
 
-CONSTEXPR_OR_INLINE vec3 operator*(const vec3 &v, const double t) {
-  return t * v;
-}
-
-CONSTEXPR_OR_INLINE vec3 operator/(const vec3 &v, const double t) {
-  return (1 / t) * v;
-}
-
-CONSTEXPR_OR_INLINE double dot(const vec3 &u, const vec3 &v) {
+CONSTEXPR_OR_INLINE real dot(const vec3 &u, const vec3 &v) {
   return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2];
 }
 
@@ -84,43 +138,81 @@ CONSTEXPR_OR_INLINE vec3 cross(const vec3 &u, const vec3 &v) {
               u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-CONSTEXPR_OR_INLINE vec3 unit_vector(const vec3 &v) { return v / v.length(); }
+#endif
 
-inline vec3 random_in_unit_disk() {
-  while (true) {
-    CONST_VAR auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0);
-    if (p.length_squared() < 1)
-      return p;
-  }
+VEC3_CONSTEXPR_OR_INLINE vec3 operator*(const vec3 &v, const real t) {
+  return t * v;
+}
+
+VEC3_CONSTEXPR_OR_INLINE vec3 operator/(const vec3 &v, const real t) {
+  return (1 / t) * v;
+}
+
+// Largest magnitude of any component of v.
+VEC3_CONSTEXPR_OR_INLINE real max_abs(const vec3 &v) {
+  return std::fmax(std::fabs(v.e[0]),
+                   std::fmax(std::fabs(v.e[1]), std::fabs(v.e[2])));
 }
 
-inline vec3 random_unit_vector() {
-  while (true) {
-    CONST_VAR auto p = vec3::random(-1, 1);
-    CONST_VAR auto lensq = p.length_squared();
-    ASSUME(lensq >= 0);
-    if (1e-160 < lensq && lensq <= 1)
-      return p / sqrt(lensq);
+VEC3_CONSTEXPR_OR_INLINE vec3 unit_vector(const vec3 &v) {
+  return v / v.length();
+}
+
+// Maps a point of the unit square to the unit disk (z = 0), keeping areas in
+// proportion and neighbouring points together (Shirley and Chiu's concentric
+// mapping), so that well spread square points stay well spread.
+inline vec3 square_to_disk(const double s, const double t) {
+  CONST_VAR double a = 2 * s - 1;
+  CONST_VAR double b = 2 * t - 1;
+  if (a == 0 && b == 0)
+    return vec3(0, 0, 0);
+  double r, phi;
+  if (std::fabs(a) > std::fabs(b)) {
+    r = a;
+    phi = (pi / 4) * (b / a);
+  } else {
+    r = b;
+    phi = (pi / 2) - (pi / 4) * (a / b);
   }
+  return vec3(r * std::cos(phi), r * std::sin(phi), 0);
+}
+
+// Maps a point of the unit square to the unit sphere, keeping areas in
+// proportion: s picks the height and t the angle around the z axis.
+inline vec3 square_to_sphere(const double s, const double t) {
+  CONST_VAR double z = 1 - 2 * s;
+  CONST_VAR double r = std::sqrt(std::fmax(0.0, 1 - z * z));
+  CONST_VAR double phi = 2 * pi * t;
+  return vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+inline vec3 random_in_unit_disk(rng &gen) {
+  CONST_VAR double s = random_double(gen);
+  return square_to_disk(s, random_double(gen));
+}
+
+inline vec3 random_unit_vector(rng &gen) {
+  CONST_VAR double s = random_double(gen);
+  return square_to_sphere(s, random_double(gen));
 }
 
-inline vec3 random_on_hemisphere(const vec3 &normal) {
-  CONST_VAR vec3 on_unit_sphere = random_unit_vector();
+inline vec3 random_on_hemisphere(const vec3 &normal, rng &gen) {
+  CONST_VAR vec3 on_unit_sphere = random_unit_vector(gen);
   if (dot(on_unit_sphere, normal) > 0.0) // In the same hemisphere as the normal
     return on_unit_sphere;
   else
     return -on_unit_sphere;
 }
 
-CONSTEXPR_OR_INLINE vec3 reflect(const vec3 &v, const vec3 &n) {
+VEC3_CONSTEXPR_OR_INLINE vec3 reflect(const vec3 &v, const vec3 &n) {
   return v - 2 * dot(v, n) * n;
 }
 
-CONSTEXPR_OR_INLINE vec3 refract(const vec3 &uv, const vec3 &n,
-                                 double etai_over_etat) {
+VEC3_CONSTEXPR_OR_INLINE vec3 refract(const vec3 &uv, const vec3 &n,
+                                      real etai_over_etat) {
   CONST_VAR auto cos_theta = std::fmin(dot(-uv, n), 1.0);
   CONST_VAR vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
-  CONST_VAR double r_out_parallel_2 =
+  CONST_VAR real r_out_parallel_2 =
       std::fabs(1.0 - r_out_perp.length_squared());
   ASSUME(r_out_parallel_2 >= 0);
   CONST_VAR vec3 r_out_parallel = -std::sqrt(r_out_parallel_2) * n;
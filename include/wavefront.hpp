@@ -0,0 +1,85 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "colour.hpp"
+#include "hittable.hpp"
+#include "light.hpp"
+#include "material.hpp"
+#include "ray.hpp"
+#include "rtweekend.hpp"
+#include "sampler.hpp"
+
+#include <vector>
+
+// Breadth-first path tracer. Rather than following one path to its end, it
+// keeps a batch of paths in flat arrays and advances all of them one bounce
+// at a time: intersect every live path, partition the hits by material kind,
+// shade each kind in bulk, then compact away the paths that terminated
+// (including those ended by Russian roulette). The result matches
+// camera::ray_colour path for path.
+class wavefront_integrator {
+public:
+  // The settings are those of the camera; the sky is background scaled by
+  // sky_brightness.
+  wavefront_integrator(const hittable &world, const material_table &materials,
+                       const light_list &lights, const int max_depth,
+                       const int roulette_depth, const bool light_sampling,
+                       colour (*background)(const ray &r),
+                       const double sky_brightness);
+
+  // Starts a new path along r, drawing its random numbers from gen.
+  void add_path(const ray &r, const sampler &gen);
+
+  int size() const;
+
+  void clear();
+
+  // Traces every path in the batch until it escapes, is absorbed or runs out
+  // of bounces.
+  void trace();
+
+  // Light carried back along path i by the last call to trace().
+  const colour &radiance(const int i) const;
+
+private:
+  const hittable &world;
+  const material_table &materials;
+  const light_list &lights;
+  int max_depth;
+  int roulette_depth;
+  bool sample_lights; // Light sampling is on and there are lights
+  colour (*background)(const ray &r);
+  double sky_brightness;
+
+  // Per-path state, indexed by path.
+  std::vector<ray> rays;
+  std::vector<colour> throughputs;
+  std::vector<sampler> gens;
+  std::vector<colour> radiances;
+  // Where each path last scattered, and the density with which it did if it
+  // also sampled the lights there (0 otherwise).
+  std::vector<point3> scatter_origins;
+  std::vector<double> scatter_pdfs;
+
+  // Per-bounce work lists, reused between calls.
+  std::vector<int> live_paths;
+  std::vector<int> next_live_paths;
+  std::vector<hit_record> recs; // Indexed by position in live_paths
+  std::vector<int> hit_order;   // Positions in live_paths, grouped by kind
+  std::vector<int> sorted_hits;
+
+  static constexpr int num_kinds = 4;
+  int kind_begin[num_kinds + 1]; // Start of each kind's group in hit_order
+
+  // Intersects every live path, whose rays have made `depth` bounces.
+  void intersect(const int depth);
+
+  void partition_by_material();
+
+  // Scatters the hits in hit_order[begin, end), which all have materials of
+  // type mat_type, for the given bounce of their paths.
+  template <class mat_type>
+  void shade(const int begin, const int end, const int bounces);
+};
+
+#endif
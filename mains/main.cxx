@@ -1,12 +1,36 @@
 #include "rtweekend.hpp"
 
 #include "camera.hpp"
-#include "hittable.hpp"
-#include "hittable_list.hpp"
-#include "material.hpp"
-#include "sphere.hpp"
+#include "checkpoint.hpp"
+#include "denoise.hpp"
+#include "image_writer.hpp"
+#include "scene_file.hpp"
+#include "scenes.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
+#include <string>
+
+// Samples per pixel a --time-budget render may take when -s does not say.
+constexpr int budget_samples = 1 << 16;
+
+// Seconds denoise() should take on a width by height image, timed on a strip
+// of its rows, as the filter's work grows with the pixels and not with what
+// they hold.
+double denoise_seconds(const int width, const int height,
+                       const denoise_settings &settings) {
+  CONST_VAR int rows = std::min(height, std::max(32, height / 8));
+  framebuffer strip(width, rows);
+  strip.enable_features();
+  CONST_VAR auto start = std::chrono::steady_clock::now();
+  denoise(strip, settings);
+  CONST_VAR std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() * height / rows;
+}
 
 void help(const camera &cam) {
 
@@ -18,16 +42,103 @@ void help(const camera &cam) {
             << cam.samples_per_pixel << ")\n";
   std::clog << "  -d, --depth\t\tSet max depth (default: " << cam.max_depth
             << ")\n";
+  std::clog << "      --roulette-depth\t\tBounces before Russian roulette may "
+               "end a path, negative for never (default: "
+            << cam.roulette_depth << ")\n";
+  std::clog << "      --sky\t\tBrightness of the sky, 0 to light the scene "
+               "by its emitting spheres alone (default: "
+            << cam.sky_brightness << ")\n";
+  std::clog << "      --no-light-sampling\t\tFind lights only by "
+               "scattering, without shadow rays towards them\n";
+  std::clog << "      --scene\t\tRender a scene file instead of the built-in "
+               "scene; later options override its camera settings\n";
+  std::clog << "      --save-scene\t\tWrite the scene and camera settings as "
+               "a text scene file\n";
+  std::clog << "      --save-binary-scene\t\tWrite the scene and camera "
+               "settings as a binary scene file\n";
+  std::clog << "  -a, --accel\t\tScene structure: bvh, list or sphere_set "
+               "(default: bvh)\n";
+  std::clog << "  -j, --threads\t\tSet render threads (default: "
+            << cam.num_threads << ", all hardware threads)\n";
+  std::clog << "      --workers\t\tRender in this many worker processes, one "
+               "thread each (default: 0, render in this process)\n";
+  std::clog << "  -p, --packets\t\tTrace camera rays in packets of "
+            << ray_packet::size << '\n';
+  std::clog << "      --wavefront\t\tAdvance batches of paths one bounce at a "
+               "time\n";
+  std::clog << "      --adaptive\t\tStop sampling a pixel once its estimated "
+               "error is below this (default: 0, off)\n";
+  std::clog << "      --min-samples\t\tSamples per pixel before adaptive "
+               "sampling may stop (default: "
+            << cam.min_samples << ")\n";
+  std::clog << "      --sampler\t\tSample pattern: random, stratified, halton "
+               "or sobol (default: sobol)\n";
+  std::clog << "      --sample-map\t\tWrite a heatmap of samples per pixel "
+               "to a file\n";
+  std::clog << "      --cost-map\t\tWrite a heatmap of render time per pixel "
+               "to a file\n";
+  std::clog << "      --denoise\t\tFilter the image, following the edges of "
+               "the first surfaces seen\n";
+  std::clog << "      --albedo-map\t\tWrite the albedo of the first surfaces "
+               "seen to a file\n";
+  std::clog << "      --normal-map\t\tWrite the normals of the first surfaces "
+               "seen to a file\n";
+  std::clog << "      --tile-csv\t\tWrite the time, samples and rays of each "
+               "tile as CSV to a file\n";
+  std::clog << "      --stats\t\tWrite render statistics as JSON to a file or "
+               "-, standard output (counted in ENABLE_STATS builds)\n";
+  std::clog << "      --checkpoint\t\tSave progress to a file now and then, "
+               "and carry on from it if it exists\n";
+  std::clog << "      --checkpoint-interval\t\tSeconds between checkpoints "
+               "(default: "
+            << cam.checkpoint_interval << ")\n";
+  std::clog << "      --time-budget\t\tRender for this many seconds from "
+               "the start, taking up to -s samples per pixel (without -s, up "
+               "to "
+            << budget_samples << ")\n";
+  std::clog << "      --progressive\t\tRender in passes of 1, 2, 4, ... "
+               "samples per pixel, replacing a file with the image after "
+               "each, or -, a stream of images on standard output\n";
+  std::clog << "      --preview-scale\t\tStart --progressive with a pass at "
+               "1/N of the resolution (default: "
+            << cam.preview_scale << ")\n";
+  std::clog << "  -o, --output\t\tWrite the image to a file (default: -, "
+               "standard output)\n";
+  std::clog << "  -f, --format\t\tImage format: p3, p6 or pfm (default: pfm "
+               "for .pfm files, p6 for other files, p3 for standard "
+               "output)\n";
+  std::clog << "      --mmap\t\tEncode the image straight into a memory "
+               "mapped file\n";
   std::clog << std::flush;
 }
 
 int main(int argc, char **argv) {
+  CONST_VAR auto program_start = std::chrono::steady_clock::now();
 
   camera cam;
   cam.aspect_ratio = 16.0 / 9.0;
   cam.image_width = 1200;
   cam.samples_per_pixel = 500;
   cam.max_depth = 50;
+  std::string accel = "bvh";
+  std::string output = "-";
+  std::string format_name;
+  bool use_mmap = false;
+  std::string sample_map;
+  std::string cost_map;
+  std::string tile_csv;
+  std::string albedo_path;
+  std::string normal_path;
+  bool use_denoise = false;
+  std::string stats_path;
+  std::string progressive_path;
+  scene loaded;
+  bool have_scene = false;
+  std::string save_text;
+  std::string save_binary;
+  int workers = 0;
+  double time_budget = 0;
+  bool samples_given = false;
 
   // Command line options
   for (int i = 1; i < argc; i++) {
@@ -44,6 +155,7 @@ int main(int argc, char **argv) {
     } else if (arg == "-s" or arg == "--samples") {
       if (i + 1 < argc) {
         cam.samples_per_pixel = std::stoi(argv[++i]);
+        samples_given = true;
         std::clog << "Setting samples per pixel to " << cam.samples_per_pixel
                   << '\n';
       }
@@ -52,6 +164,171 @@ int main(int argc, char **argv) {
         cam.max_depth = std::stoi(argv[++i]);
         std::clog << "Setting max depth to " << cam.max_depth << '\n';
       }
+    } else if (arg == "--roulette-depth") {
+      if (i + 1 < argc) {
+        cam.roulette_depth = std::stoi(argv[++i]);
+        std::clog << "Setting Russian roulette depth to " << cam.roulette_depth
+                  << '\n';
+      }
+    } else if (arg == "-j" or arg == "--threads") {
+      if (i + 1 < argc) {
+        cam.num_threads = std::stoi(argv[++i]);
+        std::clog << "Setting render threads to " << cam.num_threads << '\n';
+      }
+    } else if (arg == "--workers") {
+      if (i + 1 < argc) {
+        workers = std::stoi(argv[++i]);
+        std::clog << "Setting worker processes to " << workers << '\n';
+      }
+    } else if (arg == "-p" or arg == "--packets") {
+      cam.packet_mode = true;
+      std::clog << "Tracing camera rays in packets\n";
+    } else if (arg == "--wavefront") {
+      cam.wavefront = true;
+      std::clog << "Using the wavefront integrator\n";
+    } else if (arg == "--scene") {
+      if (i + 1 < argc) {
+        CONST_VAR std::string path = argv[++i];
+        std::clog << "Loading scene " << path << '\n';
+        loaded = scene();
+        if (!load_scene(path, cam, loaded))
+          return 1;
+        have_scene = true;
+      }
+    } else if (arg == "--sky") {
+      if (i + 1 < argc) {
+        cam.sky_brightness = std::stod(argv[++i]);
+        std::clog << "Setting sky brightness to " << cam.sky_brightness
+                  << '\n';
+      }
+    } else if (arg == "--no-light-sampling") {
+      cam.light_sampling = false;
+      std::clog << "Not sampling lights\n";
+    } else if (arg == "--save-scene") {
+      if (i + 1 < argc) {
+        save_text = argv[++i];
+        std::clog << "Saving the scene to " << save_text << '\n';
+      }
+    } else if (arg == "--save-binary-scene") {
+      if (i + 1 < argc) {
+        save_binary = argv[++i];
+        std::clog << "Saving the scene in binary to " << save_binary << '\n';
+      }
+    } else if (arg == "-a" or arg == "--accel") {
+      if (i + 1 < argc) {
+        accel = argv[++i];
+        if (accel != "bvh" and accel != "list" and accel != "sphere_set") {
+          std::cerr << "Unknown scene structure: " << accel << '\n';
+          help(cam);
+          return 1;
+        }
+        std::clog << "Setting scene structure to " << accel << '\n';
+      }
+    } else if (arg == "--adaptive") {
+      if (i + 1 < argc) {
+        cam.adaptive_threshold = std::stod(argv[++i]);
+        std::clog << "Setting adaptive sampling threshold to "
+                  << cam.adaptive_threshold << '\n';
+      }
+    } else if (arg == "--min-samples") {
+      if (i + 1 < argc) {
+        cam.min_samples = std::stoi(argv[++i]);
+        std::clog << "Setting minimum samples per pixel to "
+                  << cam.min_samples << '\n';
+      }
+    } else if (arg == "--sampler") {
+      if (i + 1 < argc) {
+        CONST_VAR std::string pattern = argv[++i];
+        if (!parse_sample_pattern(pattern, cam.sampling)) {
+          std::cerr << "Unknown sample pattern: " << pattern << '\n';
+          help(cam);
+          return 1;
+        }
+        std::clog << "Setting sample pattern to " << pattern << '\n';
+      }
+    } else if (arg == "--sample-map") {
+      if (i + 1 < argc) {
+        sample_map = argv[++i];
+        std::clog << "Writing the sample heatmap to " << sample_map << '\n';
+      }
+    } else if (arg == "--cost-map") {
+      if (i + 1 < argc) {
+        cost_map = argv[++i];
+        cam.record_cost = true;
+        std::clog << "Writing the render time heatmap to " << cost_map << '\n';
+      }
+    } else if (arg == "--denoise") {
+      use_denoise = true;
+      cam.record_features = true;
+      std::clog << "Denoising the image\n";
+    } else if (arg == "--albedo-map") {
+      if (i + 1 < argc) {
+        albedo_path = argv[++i];
+        cam.record_features = true;
+        std::clog << "Writing the albedo to " << albedo_path << '\n';
+      }
+    } else if (arg == "--normal-map") {
+      if (i + 1 < argc) {
+        normal_path = argv[++i];
+        cam.record_features = true;
+        std::clog << "Writing the normals to " << normal_path << '\n';
+      }
+    } else if (arg == "--tile-csv") {
+      if (i + 1 < argc) {
+        tile_csv = argv[++i];
+        std::clog << "Writing tile timings to " << tile_csv << '\n';
+      }
+    } else if (arg == "--stats") {
+      if (i + 1 < argc) {
+        stats_path = argv[++i];
+        std::clog << "Writing render statistics to " << stats_path << '\n';
+      }
+    } else if (arg == "--checkpoint") {
+      if (i + 1 < argc) {
+        cam.checkpoint_path = argv[++i];
+        std::clog << "Saving checkpoints to " << cam.checkpoint_path << '\n';
+      }
+    } else if (arg == "--checkpoint-interval") {
+      if (i + 1 < argc) {
+        cam.checkpoint_interval = std::stod(argv[++i]);
+        std::clog << "Setting the checkpoint interval to "
+                  << cam.checkpoint_interval << " seconds\n";
+      }
+    } else if (arg == "--time-budget") {
+      if (i + 1 < argc) {
+        time_budget = std::stod(argv[++i]);
+        std::clog << "Rendering for " << time_budget << " seconds\n";
+      }
+    } else if (arg == "--progressive") {
+      if (i + 1 < argc) {
+        progressive_path = argv[++i];
+        std::clog << "Writing every pass to " << progressive_path << '\n';
+      }
+    } else if (arg == "--preview-scale") {
+      if (i + 1 < argc) {
+        cam.preview_scale = std::stoi(argv[++i]);
+        std::clog << "Setting the preview scale to " << cam.preview_scale
+                  << '\n';
+      }
+    } else if (arg == "-o" or arg == "--output") {
+      if (i + 1 < argc) {
+        output = argv[++i];
+        std::clog << "Writing the image to " << output << '\n';
+      }
+    } else if (arg == "-f" or arg == "--format") {
+      if (i + 1 < argc) {
+        format_name = argv[++i];
+        image_format format;
+        if (!parse_image_format(format_name, format)) {
+          std::cerr << "Unknown image format: " << format_name << '\n';
+          help(cam);
+          return 1;
+        }
+        std::clog << "Setting image format to " << format_name << '\n';
+      }
+    } else if (arg == "--mmap") {
+      use_mmap = true;
+      std::clog << "Writing the image through a memory mapping\n";
     } else {
       std::cerr << "Unknown option: " << arg << '\n';
       help(cam);
@@ -59,56 +336,164 @@ int main(int argc, char **argv) {
     }
   }
 
+  if (cam.adaptive_threshold > 0 and (cam.packet_mode or cam.wavefront)) {
+    std::cerr << "Adaptive sampling cannot be combined with --packets or "
+                 "--wavefront\n";
+    return 1;
+  }
+  // These render in several goes, and each would start the error estimates
+  // of the pixels afresh.
+  if (cam.adaptive_threshold > 0 and
+      (!progressive_path.empty() or time_budget > 0 or
+       !cam.checkpoint_path.empty())) {
+    std::cerr << "Adaptive sampling cannot be combined with --progressive, "
+                 "--time-budget or --checkpoint\n";
+    return 1;
+  }
+  if (time_budget > 0 and workers > 0) {
+    std::cerr << "--time-budget cannot be combined with --workers\n";
+    return 1;
+  }
+  if (!progressive_path.empty() and workers > 0) {
+    std::cerr << "--progressive cannot be combined with --workers\n";
+    return 1;
+  }
+  if (time_budget > 0 and !samples_given)
+    cam.samples_per_pixel = budget_samples;
+
   // World
+  scene spheres;
+  if (have_scene) {
+    spheres = std::move(loaded);
+    spheres.build_world(accel);
+  } else {
+    spheres = random_spheres_scene(accel);
+    set_random_spheres_view(cam);
+  }
+  if (!save_text.empty() and !save_scene_text(save_text, cam, spheres))
+    return 1;
+  if (!save_binary.empty() and !save_scene_binary(save_binary, cam, spheres))
+    return 1;
 
-  hittable_list world;
-  auto ground_material = std::make_shared<lambertian>(colour(0.5, 0.5, 0.5));
-  world.add(
-      std::make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
-
-  for (int a = -11; a < 11; a++) {
-    for (int b = -11; b < 11; b++) {
-      auto choose_mat = random_double();
-      point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
-
-      if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-        std::shared_ptr<material> sphere_material;
-
-        if (choose_mat < 0.8) {
-          // diffuse
-          auto albedo = colour::random() * colour::random();
-          sphere_material = std::make_shared<lambertian>(albedo);
-          world.add(std::make_shared<sphere>(center, 0.2, sphere_material));
-        } else if (choose_mat < 0.95) {
-          // metal
-          auto albedo = colour::random(0.5, 1);
-          auto fuzz = random_double(0, 0.5);
-          sphere_material = std::make_shared<metal>(albedo, fuzz);
-          world.add(std::make_shared<sphere>(center, 0.2, sphere_material));
-        } else {
-          // glass
-          sphere_material = std::make_shared<dielectric>(1.5);
-          world.add(std::make_shared<sphere>(center, 0.2, sphere_material));
-        }
-      }
+  // Without -f, the format follows the file name.
+  auto format_for = [&](const std::string &path) {
+    image_format format = image_format::p3;
+    if (!format_name.empty())
+      parse_image_format(format_name, format);
+    else if (path.size() >= 4 && path.substr(path.size() - 4) == ".pfm")
+      format = image_format::pfm;
+    else if (path != "-")
+      format = image_format::p6;
+    return format;
+  };
+
+  if (!progressive_path.empty())
+    cam.preview = [&](const framebuffer &frame) {
+      replace_image(frame, format_for(progressive_path), progressive_path);
+    };
+
+  // An existing checkpoint holds samples to carry on from; it has to be of
+  // this image, as the render will replace it.
+  framebuffer resume;
+  if (!cam.checkpoint_path.empty())
+    cam.checkpoint_fingerprint = render_fingerprint(cam, spheres);
+  if (!cam.checkpoint_path.empty() and
+      std::ifstream(cam.checkpoint_path).good()) {
+    std::uint64_t fingerprint = 0;
+    if (!read_checkpoint(cam.checkpoint_path, resume, fingerprint))
+      return 1;
+    if (resume.width() != cam.image_width or
+        resume.height() != cam.height()) {
+      std::cerr << cam.checkpoint_path << " holds a " << resume.width()
+                << 'x' << resume.height() << " image, not "
+                << cam.image_width << 'x' << cam.height() << '\n';
+      return 1;
+    }
+    if (fingerprint != cam.checkpoint_fingerprint) {
+      std::cerr << cam.checkpoint_path
+                << " holds samples of another scene, view, depth or sample "
+                   "pattern\n";
+      return 1;
     }
+    std::clog << "Carrying on from " << cam.checkpoint_path << '\n';
   }
 
-  auto material1 = std::make_shared<dielectric>(1.5);
-  world.add(std::make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+  denoise_settings denoise_with;
+  denoise_with.num_threads = cam.num_threads;
 
-  auto material2 = std::make_shared<lambertian>(colour(0.4, 0.2, 0.1));
-  world.add(std::make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+  // The budget counts from the start, so what is left of it goes to the
+  // render, less the time the filter will take after it; the render takes
+  // its features inside its share. The first pass always finishes, however
+  // little that is.
+  if (time_budget > 0) {
+    CONST_VAR double filter =
+        use_denoise
+            ? denoise_seconds(cam.image_width, cam.height(), denoise_with)
+            : 0;
+    if (use_denoise)
+      std::clog << "Keeping " << filter << " s of the budget for denoising\n";
+    CONST_VAR std::chrono::duration<double> setup =
+        std::chrono::steady_clock::now() - program_start;
+    cam.time_budget = std::max(time_budget - setup.count() - filter, 1e-3);
+  }
 
-  auto material3 = std::make_shared<metal>(colour(0.7, 0.6, 0.5), 0.0);
-  world.add(std::make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+  CONST_VAR framebuffer image =
+      workers > 0
+          ? cam.render_processes(spheres.world, spheres.materials,
+                                 spheres.lights, workers, std::move(resume))
+          : cam.render(spheres.world, spheres.materials, spheres.lights,
+                       std::move(resume));
+  if (use_denoise) {
+    CONST_VAR auto start = std::chrono::steady_clock::now();
+    CONST_VAR framebuffer denoised = denoise(image, denoise_with);
+    CONST_VAR std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::clog << "Denoised in " << elapsed.count() << " s\n";
+    if (!write_image(denoised, format_for(output), output, use_mmap))
+      return 1;
+  } else if (!write_image(image, format_for(output), output, use_mmap)) {
+    return 1;
+  }
+  if (!albedo_path.empty() and !write_image(albedo_map(image),
+                                            format_for(albedo_path),
+                                            albedo_path, use_mmap))
+    return 1;
+  if (!normal_path.empty() and !write_image(normal_map(image),
+                                            format_for(normal_path),
+                                            normal_path, use_mmap))
+    return 1;
+  if (!sample_map.empty() and !write_image(sample_heatmap(image),
+                                           format_for(sample_map), sample_map,
+                                           use_mmap))
+    return 1;
+  if (!cost_map.empty() and !write_image(cost_heatmap(image),
+                                         format_for(cost_map), cost_map,
+                                         use_mmap))
+    return 1;
 
-  cam.vfov = 20;
-  cam.lookfrom = point3(13, 2, 3);
-  cam.lookat = point3(0, 0, 0);
-  cam.vup = vec3(0, 1, 0);
+  if (!tile_csv.empty()) {
+    std::ofstream csv_file(tile_csv);
+    cam.stats.write_tile_csv(csv_file);
+    if (!csv_file) {
+      std::cerr << "Cannot write " << tile_csv << '\n';
+      return 1;
+    }
+  }
 
-  cam.defocus_angle = 0.6;
-  cam.focus_dist = 10.0;
-  cam.render(world);
+  if (!stats_path.empty()) {
+#if !ENABLE_STATS
+    std::clog << "Built without ENABLE_STATS, so only the wall time is "
+                 "reported\n";
+#endif
+    if (stats_path == "-") {
+      cam.stats.write_json(std::cout);
+    } else {
+      std::ofstream stats_file(stats_path);
+      cam.stats.write_json(stats_file);
+      if (!stats_file) {
+        std::cerr << "Cannot write " << stats_path << '\n';
+        return 1;
+      }
+    }
+  }
 }
@@ -0,0 +1,72 @@
+#include "aabb.hpp"
+
+#include <utility>
+
+aabb::aabb() {}
+
+aabb::aabb(const interval &x, const interval &y, const interval &z)
+    : x(x), y(y), z(z) {}
+
+aabb::aabb(const point3 &a, const point3 &b)
+    : x(std::fmin(a[0], b[0]), std::fmax(a[0], b[0])),
+      y(std::fmin(a[1], b[1]), std::fmax(a[1], b[1])),
+      z(std::fmin(a[2], b[2]), std::fmax(a[2], b[2])) {}
+
+aabb::aabb(const aabb &box0, const aabb &box1)
+    : x(box0.x, box1.x), y(box0.y, box1.y), z(box0.z, box1.z) {}
+
+const interval &aabb::axis_interval(const int n) const {
+  if (n == 1)
+    return y;
+  if (n == 2)
+    return z;
+  return x;
+}
+
+bool aabb::hit(const ray &r, interval ray_t) const {
+  CONST_VAR vec3 inv_direction(1 / r.direction().x(), 1 / r.direction().y(),
+                               1 / r.direction().z());
+  return hit(r.origin(), inv_direction, ray_t);
+}
+
+bool aabb::hit(const point3 &origin, const vec3 &inv_direction,
+               interval ray_t) const {
+  for (int axis = 0; axis < 3; axis++) {
+    const interval &ax = axis_interval(axis);
+    auto t0 = (ax.min - origin[axis]) * inv_direction[axis];
+    auto t1 = (ax.max - origin[axis]) * inv_direction[axis];
+    if (t0 > t1)
+      std::swap(t0, t1);
+
+    // Comparisons against NaN (a ray lying in a slab plane) are false, which
+    // leaves the interval unchanged and keeps the test conservative.
+    if (t0 > ray_t.min)
+      ray_t.min = t0;
+    if (t1 < ray_t.max)
+      ray_t.max = t1;
+
+    if (ray_t.max <= ray_t.min)
+      return false;
+  }
+  return true;
+}
+
+int aabb::longest_axis() const {
+  if (x.size() > y.size())
+    return x.size() > z.size() ? 0 : 2;
+  return y.size() > z.size() ? 1 : 2;
+}
+
+point3 aabb::centroid() const {
+  return point3(0.5 * (x.min + x.max), 0.5 * (y.min + y.max),
+                0.5 * (z.min + z.max));
+}
+
+real aabb::surface_area() const {
+  CONST_VAR auto dx = x.size();
+  CONST_VAR auto dy = y.size();
+  CONST_VAR auto dz = z.size();
+  if (dx < 0 || dy < 0 || dz < 0)
+    return 0;
+  return 2 * (dx * dy + dy * dz + dz * dx);
+}
@@ -0,0 +1,90 @@
+#include "arena.hpp"
+#include "rtweekend.hpp"
+
+#include <cstdint>
+
+arena::arena(const std::size_t block_size) : block_size(block_size) {}
+
+arena::~arena() { destroy_all(); }
+
+arena::arena(arena &&other) noexcept
+    : block_size(other.block_size), blocks(std::move(other.blocks)),
+      next(other.next), end(other.end), used(other.used),
+      destructors(std::move(other.destructors)) {
+  other.blocks.clear();
+  other.destructors.clear();
+  other.next = other.end = nullptr;
+  other.used = 0;
+}
+
+arena &arena::operator=(arena &&other) noexcept {
+  if (this != &other) {
+    destroy_all();
+    block_size = other.block_size;
+    blocks = std::move(other.blocks);
+    next = other.next;
+    end = other.end;
+    used = other.used;
+    destructors = std::move(other.destructors);
+    other.blocks.clear();
+    other.destructors.clear();
+    other.next = other.end = nullptr;
+    other.used = 0;
+  }
+  return *this;
+}
+
+void arena::clear() {
+  destroy_all();
+  destructors.clear();
+  blocks.clear();
+  next = end = nullptr;
+  used = 0;
+}
+
+std::size_t arena::bytes_used() const { return used; }
+
+void *arena::allocate(const std::size_t size, const std::size_t alignment) {
+  CONST_VAR std::uintptr_t address = reinterpret_cast<std::uintptr_t>(next);
+  std::size_t padding = (alignment - address % alignment) % alignment;
+  if (next == nullptr || std::size_t(end - next) < padding + size) {
+    // Objects larger than a block get a block of their own; the current
+    // block keeps serving the small ones.
+    if (size > block_size) {
+      blocks.emplace(blocks.end() - (next == nullptr ? 0 : 1),
+                     new char[size]);
+      used += size;
+      return blocks[blocks.size() - (next == nullptr ? 1 : 2)].get();
+    }
+    blocks.emplace_back(new char[block_size]);
+    next = blocks.back().get();
+    end = next + block_size;
+    padding = 0;
+  }
+
+  char *result = next + padding;
+  next = result + size;
+  used += padding + size;
+  return result;
+}
+
+void arena::add_destructor(void *object, const std::size_t size,
+                           void (*destroy)(void *)) {
+  char *const start = static_cast<char *>(object);
+  if (!destructors.empty()) {
+    destructor_run &last = destructors.back();
+    if (last.destroy == destroy && last.size == size &&
+        last.first + last.count * size == start) {
+      last.count++;
+      return;
+    }
+  }
+  destructors.push_back({destroy, start, size, 1});
+}
+
+void arena::destroy_all() {
+  // In reverse order of construction, like automatic objects.
+  for (auto run = destructors.rbegin(); run != destructors.rend(); ++run)
+    for (std::size_t i = run->count; i-- > 0;)
+      run->destroy(run->first + i * run->size);
+}
@@ -0,0 +1,292 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+
+bvh_node::bvh_node(const hittable_list &list) : owners(list.owned()) {
+  std::vector<build_entry> entries;
+  entries.reserve(list.objects.size());
+  for (CONST_VAR auto object : list.objects) {
+    CONST_VAR aabb bbox = object->bounding_box();
+    entries.push_back({bbox, bbox.centroid(), object});
+  }
+
+  objects.reserve(entries.size());
+  nodes.reserve(2 * entries.size());
+  if (!entries.empty())
+    build(entries, 0, int(entries.size()), 0);
+}
+
+bool bvh_node::intersect(const ray &r, interval ray_t,
+                         hit_candidate &hit) const {
+  if (nodes.empty())
+    return false;
+
+  const vec3 &direction = r.direction();
+  CONST_VAR vec3 inv_direction(1 / direction.x(), 1 / direction.y(),
+                               1 / direction.z());
+
+  bool hit_anything = false;
+  int stack[max_stack_depth];
+  int stack_size = 0;
+  int current = 0;
+
+  while (true) {
+    const node &n = nodes[current];
+    // ray_t.max shrinks to the closest hit so far, so boxes behind it are
+    // culled without testing their contents.
+    if (n.bbox.hit(r.origin(), inv_direction, ray_t)) {
+      if (n.count > 0) {
+        for (int k = n.first; k < n.first + n.count; k++) {
+          if (objects[k]->intersect(r, ray_t, hit)) {
+            hit_anything = true;
+            ray_t.max = hit.t;
+          }
+        }
+      } else {
+        // Descend into the child nearer the ray origin first.
+        if (direction[n.split_axis] < 0) {
+          stack[stack_size++] = current + 1;
+          current = n.first;
+        } else {
+          stack[stack_size++] = n.first;
+          current = current + 1;
+        }
+        continue;
+      }
+    }
+    if (stack_size == 0)
+      break;
+    current = stack[--stack_size];
+  }
+
+  return hit_anything;
+}
+
+bool bvh_node::occluded(const ray &r, interval ray_t) const {
+  if (nodes.empty())
+    return false;
+
+  const vec3 &direction = r.direction();
+  CONST_VAR vec3 inv_direction(1 / direction.x(), 1 / direction.y(),
+                               1 / direction.z());
+
+  // Any hit ends the search, so the range never shrinks and the children
+  // are visited in storage order.
+  int stack[max_stack_depth];
+  int stack_size = 0;
+  int current = 0;
+
+  while (true) {
+    const node &n = nodes[current];
+    if (n.bbox.hit(r.origin(), inv_direction, ray_t)) {
+      if (n.count == 0) {
+        stack[stack_size++] = n.first;
+        current = current + 1;
+        continue;
+      }
+      for (int k = n.first; k < n.first + n.count; k++)
+        if (objects[k]->occluded(r, ray_t))
+          return true;
+    }
+    if (stack_size == 0)
+      return false;
+    current = stack[--stack_size];
+  }
+}
+
+void bvh_node::finalize(const ray &r, const hit_candidate &hit,
+                        hit_record &rec) const {
+  hit.object->finalize(r, hit, rec);
+}
+
+unsigned bvh_node::intersect_packet(ray_packet &packet,
+                                    hit_candidate *hits) const {
+  constexpr int size = ray_packet::size;
+  if (nodes.empty() || !packet.active)
+    return 0;
+
+  point3 origins[size];
+  vec3 inv_directions[size];
+  for (int lane = 0; lane < size; lane++) {
+    origins[lane] = point3(packet.origin_x[lane], packet.origin_y[lane],
+                           packet.origin_z[lane]);
+    inv_directions[lane] =
+        vec3(1 / packet.direction_x[lane], 1 / packet.direction_y[lane],
+             1 / packet.direction_z[lane]);
+  }
+
+  // Coherent rays share direction signs, so the first active lane decides
+  // the front-to-back order for the whole packet.
+  CONST_VAR unsigned active = packet.active;
+  CONST_VAR int lead = __builtin_ctz(active);
+  CONST_VAR bool negative[3] = {packet.direction_x[lead] < 0,
+                                packet.direction_y[lead] < 0,
+                                packet.direction_z[lead] < 0};
+
+  // Nodes are entered as soon as one lane hits their box ("first hit"
+  // traversal). Lanes before that lane missed the box, so the children only
+  // need to consider the lanes from it onwards; for coherent rays one box
+  // test usually decides a node for the whole packet.
+  class entry {
+  public:
+    int node;
+    int first_lane;
+  };
+  entry stack[max_stack_depth];
+  int stack_size = 0;
+  entry current = {0, lead};
+  unsigned hit_lanes = 0;
+
+  while (true) {
+    const node &n = nodes[current.node];
+    int lane = current.first_lane;
+    for (; lane < size; lane++) {
+      if ((active & (1u << lane)) &&
+          n.bbox.hit(origins[lane], inv_directions[lane],
+                     interval(packet.t_min, packet.t_max[lane])))
+        break;
+    }
+
+    if (lane < size) {
+      if (n.count > 0) {
+        packet.active = active & ~((1u << lane) - 1);
+        for (int k = n.first; k < n.first + n.count; k++)
+          hit_lanes |= objects[k]->intersect_packet(packet, hits);
+        packet.active = active;
+      } else {
+        if (negative[n.split_axis]) {
+          stack[stack_size++] = {current.node + 1, lane};
+          current = {n.first, lane};
+        } else {
+          stack[stack_size++] = {n.first, lane};
+          current = {current.node + 1, lane};
+        }
+        continue;
+      }
+    }
+    if (stack_size == 0)
+      break;
+    current = stack[--stack_size];
+  }
+
+  return hit_lanes;
+}
+
+aabb bvh_node::bounding_box() const {
+  return nodes.empty() ? aabb() : nodes[0].bbox;
+}
+
+int bvh_node::build(std::vector<build_entry> &entries, const int start,
+                    const int end, const int depth) {
+  aabb bbox;
+  aabb centroid_bounds;
+  for (int i = start; i < end; i++) {
+    bbox = aabb(bbox, entries[i].bbox);
+    centroid_bounds =
+        aabb(centroid_bounds, aabb(entries[i].centroid, entries[i].centroid));
+  }
+
+  CONST_VAR int count = end - start;
+  if (count == 1)
+    return make_leaf(entries, bbox, start, end);
+
+  int split_axis = centroid_bounds.longest_axis();
+  int mid = start + count / 2;
+  bool partitioned = false;
+
+  if (depth < max_sah_depth) {
+    // Bin the centroids along each axis and pick the bin boundary with the
+    // lowest surface area heuristic cost.
+    double best_cost = std::numeric_limits<double>::infinity();
+    int best_axis = -1;
+    int best_bin = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+      const interval &extent = centroid_bounds.axis_interval(axis);
+      if (extent.size() <= 0)
+        continue;
+      CONST_VAR double bin_scale = num_bins / extent.size();
+
+      int bin_counts[num_bins] = {};
+      aabb bin_boxes[num_bins];
+      for (int i = start; i < end; i++) {
+        int bin = int((entries[i].centroid[axis] - extent.min) * bin_scale);
+        bin = std::min(bin, num_bins - 1);
+        bin_counts[bin]++;
+        bin_boxes[bin] = aabb(bin_boxes[bin], entries[i].bbox);
+      }
+
+      // Sweep from the right to get the cost of every right-hand side.
+      double right_costs[num_bins];
+      aabb right_box;
+      int right_count = 0;
+      for (int bin = num_bins - 1; bin > 0; bin--) {
+        right_box = aabb(right_box, bin_boxes[bin]);
+        right_count += bin_counts[bin];
+        right_costs[bin] = right_count * right_box.surface_area();
+      }
+
+      aabb left_box;
+      int left_count = 0;
+      for (int bin = 0; bin < num_bins - 1; bin++) {
+        left_box = aabb(left_box, bin_boxes[bin]);
+        left_count += bin_counts[bin];
+        CONST_VAR double cost =
+            left_count * left_box.surface_area() + right_costs[bin + 1];
+        if (left_count > 0 && left_count < count && cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_bin = bin;
+        }
+      }
+    }
+
+    if (best_axis < 0) {
+      // Every centroid coincides, so no plane separates the objects.
+      if (count <= max_leaf_size)
+        return make_leaf(entries, bbox, start, end);
+    } else {
+      CONST_VAR double area = bbox.surface_area();
+      CONST_VAR double split_cost =
+          traversal_cost + (area > 0 ? best_cost / area : 0);
+      if (count <= max_leaf_size && split_cost >= count)
+        return make_leaf(entries, bbox, start, end);
+
+      split_axis = best_axis;
+      const interval &extent = centroid_bounds.axis_interval(split_axis);
+      CONST_VAR double bin_scale = num_bins / extent.size();
+      auto in_left = [&](const build_entry &entry) {
+        int bin = int((entry.centroid[split_axis] - extent.min) * bin_scale);
+        return std::min(bin, num_bins - 1) <= best_bin;
+      };
+      mid = int(std::partition(entries.begin() + start, entries.begin() + end,
+                               in_left) -
+                entries.begin());
+      partitioned = true;
+    }
+  }
+
+  if (!partitioned) {
+    std::nth_element(entries.begin() + start, entries.begin() + mid,
+                     entries.begin() + end,
+                     [&](const build_entry &a, const build_entry &b) {
+                       return a.centroid[split_axis] < b.centroid[split_axis];
+                     });
+  }
+
+  CONST_VAR int index = int(nodes.size());
+  nodes.push_back({bbox, 0, 0, split_axis});
+  build(entries, start, mid, depth + 1);
+  CONST_VAR int right = build(entries, mid, end, depth + 1);
+  nodes[index].first = right;
+  return index;
+}
+
+int bvh_node::make_leaf(const std::vector<build_entry> &entries,
+                        const aabb &bbox, const int start, const int end) {
+  CONST_VAR int index = int(nodes.size());
+  nodes.push_back({bbox, int(objects.size()), end - start, 0});
+  for (int i = start; i < end; i++)
+    objects.push_back(entries[i].object);
+  return index;
+}
@@ -1,34 +1,514 @@
 #include "camera.hpp"
+#include "checkpoint.hpp"
+#include "render_stats.hpp"
+#include "russian_roulette.hpp"
 #include "rtweekend.hpp"
+#include "thread_pool.hpp"
+#include "wavefront.hpp"
 
-void camera::render(const hittable &world) {
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+// Running mean and variance of the luminance of a pixel's samples, updated
+// with Welford's algorithm.
+class luminance_estimate {
+public:
+  void add(const colour &sample) {
+    CONST_VAR double y = luminance(sample);
+    count++;
+    CONST_VAR double delta = y - mean;
+    mean += delta / count;
+    m2 += delta * (y - mean);
+  }
+
+  // True once the standard error of the mean is below threshold times the
+  // square root of the mean. The image is written with gamma 2, so this keeps
+  // the error of the written value below threshold / 2 in every pixel instead
+  // of spending most samples on dark ones. Very dark pixels are measured
+  // against a floor, so that black pixels also converge.
+  bool converged(const double threshold) const {
+    if (count < 2)
+      return false;
+    constexpr double floor = 1.0 / 256;
+    CONST_VAR double variance = m2 / (count - 1);
+    CONST_VAR double standard_error = std::sqrt(variance / count);
+    return standard_error <= threshold * std::sqrt(std::fmax(mean, floor));
+  }
+
+private:
+  int count = 0;
+  double mean = 0;
+  double m2 = 0;
+};
+
+// Now if timed, a dummy time point that costs nothing to make otherwise.
+std::chrono::steady_clock::time_point start_time(const bool timed) {
+  return timed ? std::chrono::steady_clock::now()
+               : std::chrono::steady_clock::time_point();
+}
+
+} // namespace
+
+framebuffer camera::render(const hittable &world,
+                           const material_table &materials,
+                           const light_list &lights, framebuffer image) {
+  this->materials = &materials;
+  this->lights = &lights;
   initialize();
-  // Translate the [0,1] component values to the byte range [0,255].
-  interval intensity(0.000, 0.999);
 
-  std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+  image = start_image(std::move(image));
+  if (record_cost)
+    image.enable_costs();
+  CONST_VAR std::vector<tile> tiles = make_tiles();
+  std::unique_ptr<checkpoint_writer> checkpoint;
+  if (!checkpoint_path.empty())
+    checkpoint.reset(
+        new checkpoint_writer(checkpoint_path, checkpoint_interval,
+                              checkpoint_fingerprint, image));
+
+  thread_pool pool(num_threads > 0 ? num_threads
+                                   : thread_pool::default_threads());
+  std::clog << "Rendering " << tiles.size() << " tiles on " << pool.size()
+            << " threads\n";
+
+  std::mutex progress_lock;
+  std::vector<render_stats> thread_stats(pool.size());
+  CONST_VAR auto start = std::chrono::steady_clock::now();
+  if (preview && preview_scale > 1) {
+    render_coarse_preview(world, pool);
+    std::clog << "Preview at 1/" << preview_scale << " of the resolution after "
+              << seconds_since(start) << " s\n";
+  }
+
+  // A budgeted render takes its features first, so that the passes only
+  // get the time they leave.
+  CONST_VAR bool budgeted = time_budget > 0;
+  if (budgeted && record_features)
+    render_features(world, image, pool);
+
+  // Each pass of a progressive render doubles the samples of the one before,
+  // so that the passes before the last take no longer than the last; those
+  // of a budgeted render take what fits. Passes that every pixel already
+  // has the samples of are skipped.
+  int first_limit = samples_per_pixel;
+  if (preview || budgeted) {
+    CONST_VAR int fewest = fewest_samples(image);
+    first_limit = 1;
+    while (first_limit <= fewest)
+      first_limit *= 2;
+  }
+  for (int limit = first_limit;;) {
+    sample_limit = limit < samples_per_pixel ? limit : samples_per_pixel;
+    CONST_VAR bool may_skip = budgeted && limit > first_limit;
+    CONST_VAR std::uint64_t samples_before =
+        budgeted ? total_samples(image) : 0;
+    CONST_VAR auto pass_start = std::chrono::steady_clock::now();
+    int tiles_remaining = int(tiles.size());
+    pool.parallel_for(int(tiles.size()), [&](int thread_id, int index) {
+      CONST_VAR tile &t = tiles[index];
+      if (!may_skip || seconds_since(start) < time_budget) {
+        CONST_VAR std::uint64_t samples_before = tile_samples(t, image);
+        CONST_VAR auto tile_start = std::chrono::steady_clock::now();
+        render_tile(world, t, image);
+        CONST_VAR double tile_seconds = seconds_since(tile_start);
+        if (checkpoint)
+          checkpoint->add_finished(image, t.x0, t.y0, t.x1, t.y1);
+
+        render_stats &local = render_stats::local();
+        local.tiles.push_back({t.x0, t.y0, t.x1, t.y1, thread_id,
+                               tile_seconds,
+                               tile_samples(t, image) - samples_before,
+                               local.rays()});
 
+        // Move the counters of this tile out of the thread-local copy, which
+        // outlives the render, into this thread's slot.
+        thread_stats[thread_id] += local;
+        local = render_stats();
+      }
+
+      std::lock_guard<std::mutex> guard(progress_lock);
+      tiles_remaining--;
+      std::clog << "\rTiles remaining: " << tiles_remaining << ' '
+                << std::flush;
+    });
+    if (preview) {
+      std::clog << "\rSamples per pixel so far: " << sample_limit << " ("
+                << seconds_since(start) << " s)\n";
+      preview(image);
+    }
+    if (sample_limit >= samples_per_pixel)
+      break;
+
+    limit = preview ? 2 * sample_limit : samples_per_pixel;
+    if (budgeted) {
+      // Seconds one more sample in every pixel takes, from this pass.
+      CONST_VAR double added =
+          double(total_samples(image) - samples_before) /
+          (double(image_width) * image_height);
+      CONST_VAR double left = time_budget - seconds_since(start);
+      if (added <= 0 || left <= 0)
+        break;
+      CONST_VAR double per_sample = seconds_since(pass_start) / added;
+      if (left < per_sample)
+        break;
+      // Taking half of what is left keeps the last passes short, so a wrong
+      // estimate costs little.
+      CONST_VAR int fits = std::max(1, int(left / 2 / per_sample));
+      limit = std::min(limit, sample_limit + fits);
+    }
+  }
+
+  std::clog << "\rDone.                 \n";
+  if (checkpoint)
+    checkpoint->write();
+  if (record_features && !budgeted)
+    render_features(world, image, pool);
+  finish_render(image, thread_stats, pool.size(), seconds_since(start));
+  return image;
+}
+
+void camera::render_coarse_preview(const hittable &world,
+                                   thread_pool &pool) const {
+  camera coarse = *this;
+  coarse.image_width = image_width / preview_scale;
+  if (coarse.image_width < 1)
+    coarse.image_width = 1;
+  coarse.samples_per_pixel = 1;
+  coarse.adaptive_threshold = 0;
+  coarse.record_cost = false;
+  coarse.initialize();
+  framebuffer small(coarse.image_width, coarse.image_height);
+  CONST_VAR std::vector<tile> tiles = coarse.make_tiles();
+  pool.parallel_for(int(tiles.size()), [&](int, int index) {
+    coarse.render_tile(world, tiles[index], small);
+    // These samples are not part of the render's counts.
+    render_stats::local() = render_stats();
+  });
+
+  framebuffer scaled(image_width, image_height);
   for (int j = 0; j < image_height; j++) {
-    std::clog << "\rScanlines remaining: " << (image_height - j) << ' '
-              << std::flush;
+    CONST_VAR int y = int(std::int64_t(j) * small.height() / image_height);
     for (int i = 0; i < image_width; i++) {
+      CONST_VAR int x = int(std::int64_t(i) * small.width() / image_width);
+      scaled.add_samples(i, j, small.pixel(x, y), 1);
+    }
+  }
+  preview(scaled);
+}
+
+int camera::height() const {
+  CONST_VAR int height = int(image_width / aspect_ratio);
+  return (height < 1) ? 1 : height;
+}
+
+framebuffer camera::start_image(framebuffer image) const {
+  if (image.width() == image_width && image.height() == image_height)
+    return image;
+  if (image.width() > 0)
+    std::clog << "Ignoring the samples of a " << image.width() << 'x'
+              << image.height() << " image, the render is " << image_width
+              << 'x' << image_height << '\n';
+  return framebuffer(image_width, image_height);
+}
+
+void camera::finish_render(const framebuffer &image,
+                           const std::vector<render_stats> &thread_stats,
+                           const int threads, const double seconds) {
+  if (adaptive_threshold > 0 || time_budget > 0) {
+    std::uint64_t total = 0;
+    int fewest = std::numeric_limits<int>::max();
+    int most = 0;
+    for (int j = 0; j < image_height; j++) {
+      for (int i = 0; i < image_width; i++) {
+        CONST_VAR int samples = image.samples(i, j);
+        total += samples;
+        fewest = std::min(fewest, samples);
+        most = std::max(most, samples);
+      }
+    }
+    std::clog << "Average samples per pixel: "
+              << double(total) / (double(image_width) * image_height);
+    if (time_budget > 0)
+      std::clog << " (fewest " << fewest << ", most " << most << ')';
+    std::clog << '\n';
+  }
+
+  stats = render_stats();
+  for (CONST_VAR auto &thread : thread_stats)
+    stats += thread;
+  stats.threads = threads;
+  stats.seconds = seconds;
+#if ENABLE_STATS
+  stats.print(std::clog);
+#endif
+}
+
+void camera::render_features(const hittable &world, framebuffer &image,
+                             thread_pool &pool) const {
+  image.enable_features();
+  pool.parallel_for(image_height, [&](int, int j) {
+    for (int i = 0; i < image_width; i++) {
+      CONST_VAR auto pixel = std::uint64_t(j) * image_width + i;
+      CONST_VAR int taken = image.samples(i, j);
+      // No more samples than the pixel takes, unless it has none yet.
+      CONST_VAR int samples = (taken >= 1 && taken < feature_samples)
+                                  ? taken
+                                  : int(feature_samples);
+      colour albedo(0, 0, 0);
+      vec3 normal(0, 0, 0);
+      for (int sample = 0; sample < samples; sample++) {
+        sampler gen(sampling, pixel, sample, samples_per_pixel);
+        ray r = get_ray(i, j, gen);
+        // Mirrors and glass show other surfaces, whose features are the
+        // ones to keep apart, so the path is followed through them with
+        // their tint.
+        colour tint(1, 1, 1);
+        for (int bounces = 1;; bounces++) {
+          hit_record rec;
+          if (!world.hit(r, interval(0, std::numeric_limits<real>::infinity()),
+                         rec)) {
+            // The sky faces the camera.
+            albedo += tint * (sky_brightness * background(r));
+            normal += -unit_vector(r.direction());
+            break;
+          }
+          const material &mat = (*materials)[rec.mat];
+          ray scattered;
+          colour attenuation;
+          gen.start_bounce(bounces);
+          if (mat.diffuse() || bounces >= max_depth ||
+              bounces >= feature_depth ||
+              !mat.scatter(r, rec, attenuation, scattered, gen)) {
+            albedo += tint * mat.albedo();
+            normal += rec.normal;
+            break;
+          }
+          tint = tint * attenuation;
+          r = scattered;
+        }
+      }
+      image.set_features(i, j, albedo / samples, normal / samples);
+    }
+    // These rays are not part of the render's counts.
+    render_stats::local() = render_stats();
+  });
+}
+
+std::vector<camera::tile> camera::make_tiles() const {
+  CONST_VAR int size = (tile_size < 1) ? 1 : tile_size;
+  std::vector<tile> tiles;
+  for (int y0 = 0; y0 < image_height; y0 += size)
+    for (int x0 = 0; x0 < image_width; x0 += size)
+      tiles.push_back({x0, y0, std::min(x0 + size, image_width),
+                       std::min(y0 + size, image_height)});
+  return tiles;
+}
+
+int camera::fewest_samples(const framebuffer &image) {
+  int fewest = std::numeric_limits<int>::max();
+  for (int j = 0; j < image.height(); j++)
+    for (int i = 0; i < image.width(); i++)
+      fewest = std::min(fewest, image.samples(i, j));
+  return fewest;
+}
+
+std::uint64_t camera::total_samples(const framebuffer &image) {
+  std::uint64_t samples = 0;
+  for (int j = 0; j < image.height(); j++)
+    for (int i = 0; i < image.width(); i++)
+      samples += image.samples(i, j);
+  return samples;
+}
+
+std::uint64_t camera::tile_samples(const tile &t, const framebuffer &image) {
+  std::uint64_t samples = 0;
+  for (int j = t.y0; j < t.y1; j++)
+    for (int i = t.x0; i < t.x1; i++)
+      samples += image.samples(i, j);
+  return samples;
+}
+
+void camera::render_tile(const hittable &world, const tile &t,
+                         framebuffer &image) const {
+  if (wavefront) {
+    render_tile_wavefront(world, t, image);
+    return;
+  }
+  if (packet_mode) {
+    render_tile_packets(world, t, image);
+    return;
+  }
+
+  CONST_VAR bool adaptive = adaptive_threshold > 0;
+  for (int j = t.y0; j < t.y1; j++) {
+    for (int i = t.x0; i < t.x1; i++) {
+      CONST_VAR auto pixel_start = start_time(record_cost);
       colour pixel_colour(0, 0, 0);
-      for (int sample = 0; sample < samples_per_pixel; sample++) {
-        CONST_VAR ray r = get_ray(i, j);
-        pixel_colour += ray_colour(r, max_depth, world);
+      luminance_estimate estimate;
+      CONST_VAR auto pixel = std::uint64_t(j) * image_width + i;
+      // Carry on after the samples the pixel already has.
+      CONST_VAR int first = image.samples(i, j);
+      int sample = first;
+      while (sample < sample_limit) {
+        sampler gen(sampling, pixel, sample, samples_per_pixel);
+        CONST_VAR ray r = get_ray(i, j, gen);
+        CONST_VAR colour sample_colour = ray_colour(r, world, gen);
+        pixel_colour += sample_colour;
+        sample++;
+
+        if (adaptive) {
+          estimate.add(sample_colour);
+          if (sample >= min_samples &&
+              sample % adaptive_check_interval == 0 &&
+              estimate.converged(adaptive_threshold))
+            break;
+        }
       }
-      write_colour(std::cout, pixel_samples_scale * pixel_colour, intensity);
+      image.add_samples(i, j, pixel_colour, std::max(sample - first, 0));
+      if (record_cost)
+        image.add_cost(i, j, seconds_since(pixel_start));
     }
   }
+}
 
-  std::clog << "\rDone.                 \n";
+void camera::render_tile_packets(const hittable &world, const tile &t,
+                                 framebuffer &image) const {
+  constexpr int size = ray_packet::size;
+  CONST_VAR auto infinity = std::numeric_limits<double>::infinity();
+
+  // Camera rays for a run of neighbouring pixels in a row are traced to their
+  // first hit together; each lane then continues its path on its own.
+  for (int j = t.y0; j < t.y1; j++) {
+    for (int i0 = t.x0; i0 < t.x1; i0 += size) {
+      CONST_VAR int lanes = std::min(size, t.x1 - i0);
+      CONST_VAR auto run_start = start_time(record_cost);
+      colour pixel_colours[size];
+
+      // Each lane carries on after the samples its pixel already has.
+      int first[size];
+      int first_sample = sample_limit;
+      for (int lane = 0; lane < lanes; lane++) {
+        first[lane] = image.samples(i0 + lane, j);
+        first_sample = std::min(first_sample, first[lane]);
+      }
+
+      for (int sample = first_sample; sample < sample_limit; sample++) {
+        sampler gens[size];
+        ray rays[size];
+        ray_packet packet;
+        for (int lane = 0; lane < lanes; lane++) {
+          if (sample < first[lane])
+            continue;
+          CONST_VAR auto pixel = std::uint64_t(j) * image_width + i0 + lane;
+          gens[lane] = sampler(sampling, pixel, sample, samples_per_pixel);
+          rays[lane] = get_ray(i0 + lane, j, gens[lane]);
+          packet.set(lane, rays[lane], infinity);
+        }
+
+        if (max_depth <= 0)
+          continue;
+
+        CONST_VAR unsigned sampled = packet.active;
+        STATS_ADD(rays_by_depth[0], __builtin_popcount(sampled));
+        hit_candidate hits[size];
+        CONST_VAR unsigned hit_lanes = world.intersect_packet(packet, hits);
+        for (int lane = 0; lane < lanes; lane++) {
+          if (!(sampled & (1u << lane)))
+            continue;
+          if (hit_lanes & (1u << lane)) {
+            hit_record rec;
+            hits[lane].object->finalize(rays[lane], hits[lane], rec);
+            pixel_colours[lane] +=
+                hit_colour(rays[lane], rec, world, gens[lane]);
+          } else {
+            STATS_ADD(paths_escaped, 1);
+            pixel_colours[lane] += sky_brightness * background(rays[lane]);
+          }
+        }
+      }
+
+      for (int lane = 0; lane < lanes; lane++)
+        image.add_samples(i0 + lane, j, pixel_colours[lane],
+                          std::max(sample_limit - first[lane], 0));
+
+      // The lanes share their packet, so they share its time evenly.
+      if (record_cost) {
+        CONST_VAR double lane_seconds = seconds_since(run_start) / lanes;
+        for (int lane = 0; lane < lanes; lane++)
+          image.add_cost(i0 + lane, j, lane_seconds);
+      }
+    }
+  }
 }
 
-void camera::initialize() {
-  image_height = int(image_width / aspect_ratio);
-  image_height = (image_height < 1) ? 1 : image_height;
+void camera::render_tile_wavefront(const hittable &world, const tile &t,
+                                   framebuffer &image) const {
+  CONST_VAR int tile_pixels = (t.x1 - t.x0) * (t.y1 - t.y0);
+  CONST_VAR int samples_per_batch =
+      std::max(1, wavefront_batch_size / tile_pixels);
+  wavefront_integrator integrator(world, *materials, *lights, max_depth,
+                                  roulette_depth, light_sampling,
+                                  &camera::background, sky_brightness);
+
+  // Samples each pixel had before this render.
+  CONST_VAR int width = t.x1 - t.x0;
+  std::vector<int> have;
+  have.reserve(tile_pixels);
+  int first_sample = sample_limit;
+  for (int j = t.y0; j < t.y1; j++) {
+    for (int i = t.x0; i < t.x1; i++) {
+      have.push_back(image.samples(i, j));
+      first_sample = std::min(first_sample, have.back());
+    }
+  }
+
+  for (int first = first_sample; first < sample_limit;
+       first += samples_per_batch) {
+    CONST_VAR int last = std::min(first + samples_per_batch, sample_limit);
+    CONST_VAR auto batch_start = start_time(record_cost);
 
-  pixel_samples_scale = 1.0 / samples_per_pixel;
+    // Generate: one path per pixel sample, pixel by pixel, skipping the
+    // samples the pixel already has.
+    integrator.clear();
+    for (int j = t.y0; j < t.y1; j++) {
+      for (int i = t.x0; i < t.x1; i++) {
+        CONST_VAR auto pixel = std::uint64_t(j) * image_width + i;
+        for (int sample = std::max(first, have[(j - t.y0) * width + i - t.x0]);
+             sample < last; sample++) {
+          sampler gen(sampling, pixel, sample, samples_per_pixel);
+          CONST_VAR ray r = get_ray(i, j, gen);
+          integrator.add_path(r, gen);
+        }
+      }
+    }
+
+    integrator.trace();
+
+    int path = 0;
+    for (int j = t.y0; j < t.y1; j++)
+      for (int i = t.x0; i < t.x1; i++)
+        for (int sample = std::max(first, have[(j - t.y0) * width + i - t.x0]);
+             sample < last; sample++)
+          image.add_samples(i, j, integrator.radiance(path++), 1);
+
+    // Paths of a batch are traced together, so only the batch can be timed;
+    // its pixels share the time evenly.
+    if (record_cost) {
+      CONST_VAR double pixel_seconds = seconds_since(batch_start) / tile_pixels;
+      for (int j = t.y0; j < t.y1; j++)
+        for (int i = t.x0; i < t.x1; i++)
+          image.add_cost(i, j, pixel_seconds);
+    }
+  }
+}
+
+void camera::initialize() {
+  image_height = height();
+  sample_limit = samples_per_pixel;
 
   center = lookfrom;
 
@@ -66,50 +546,112 @@ void camera::initialize() {
   defocus_disk_v = v * defocus_radius;
 }
 
-ray camera::get_ray(int i, int j) const {
+ray camera::get_ray(int i, int j, sampler &gen) const {
   // Construct a camera ray originating from the defocus disk and directed at
   // a randomly sampled point around the pixel location i, j.
 
-  CONST_VAR auto offset = sample_square();
+  CONST_VAR auto offset = sample_square(gen);
   CONST_VAR auto pixel_sample = pixel00_loc +
                                 ((i + offset.x()) * pixel_delta_u) +
                                 ((j + offset.y()) * pixel_delta_v);
 
   CONST_VAR auto ray_origin =
-      (defocus_angle <= 0) ? center : defocus_disk_sample();
+      (defocus_angle <= 0) ? center : defocus_disk_sample(gen);
   CONST_VAR auto ray_direction = pixel_sample - ray_origin;
 
   return ray(ray_origin, ray_direction);
 }
 
-vec3 camera::sample_square() const {
+vec3 camera::sample_square(sampler &gen) const {
   // Returns the vector to a random point in the [-.5,-.5]-[+.5,+.5] unit
   // square.
-  return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+  CONST_VAR sample_2d p = gen.next_2d();
+  return vec3(p.u - 0.5, p.v - 0.5, 0);
 }
 
-point3 camera::defocus_disk_sample() const {
+point3 camera::defocus_disk_sample(sampler &gen) const {
   // Returns a random point in the camera defocus disk.
-  CONST_VAR auto p = random_in_unit_disk();
+  CONST_VAR sample_2d s = gen.next_2d();
+  CONST_VAR auto p = square_to_disk(s.u, s.v);
   return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
 }
 
-colour camera::ray_colour(const ray &r, int depth,
-                          const hittable &world) const {
+colour camera::ray_colour(const ray &r, const hittable &world,
+                          sampler &gen) const {
   // If we've exceeded the ray bounce limit, no more light is gathered.
-  if (depth <= 0)
+  if (max_depth <= 0)
     return colour(0, 0, 0);
   hit_record rec;
 
-  if (world.hit(r, interval(0.001, std::numeric_limits<double>::infinity()),
-                rec)) {
+  STATS_ADD(rays_by_depth[0], 1);
+  // Rays start off any surface (see hit_record::spawn_origin), so every hit
+  // in front of them counts.
+  if (world.hit(r, interval(0, std::numeric_limits<real>::infinity()), rec))
+    return hit_colour(r, rec, world, gen);
+
+  STATS_ADD(paths_escaped, 1);
+  return sky_brightness * background(r);
+}
+
+colour camera::hit_colour(ray r, hit_record rec, const hittable &world,
+                          sampler &gen) const {
+  // Follow the path iteratively, carrying the product of the attenuations
+  // so far instead of multiplying them in on the way back up, and adding up
+  // the light found along the way.
+  colour throughput(1, 1, 1);
+  colour radiance(0, 0, 0);
+  CONST_VAR bool sample_lights = light_sampling && !lights->empty();
+  // Where the last bounce scattered r, and the density with which it did if
+  // it also sampled the lights (0 otherwise).
+  point3 scatter_origin;
+  double scatter_pdf = 0;
+  for (int bounces = 1;; bounces++) {
+    const material &mat = (*materials)[rec.mat];
+    if (mat.kind() == material_kind::diffuse_light)
+      radiance += throughput * emitted_light(*lights, mat, rec,
+                                             scatter_origin, scatter_pdf);
+
+    // A light sample shares the light the next bounce would find, so it is
+    // only taken where there is a next bounce.
+    gen.start_bounce(bounces);
+    CONST_VAR bool sampled_lights =
+        sample_lights && mat.diffuse() && bounces < max_depth;
+    if (sampled_lights)
+      radiance +=
+          throughput * sample_direct_light(world, *lights, mat, rec, gen);
+
     ray scattered;
     colour attenuation;
-    if (rec.mat->scatter(r, rec, attenuation, scattered))
-      return attenuation * ray_colour(scattered, depth - 1, world);
-    return colour(0, 0, 0);
+    if (!mat.scatter(r, rec, attenuation, scattered, gen)) {
+      STATS_ADD(paths_absorbed, 1);
+      return radiance;
+    }
+    throughput = throughput * attenuation;
+
+    if (bounces >= max_depth) {
+      STATS_ADD(paths_max_depth, 1);
+      return radiance;
+    }
+    if (!survives_roulette(throughput, bounces, roulette_depth, gen)) {
+      STATS_ADD(paths_roulette, 1);
+      return radiance;
+    }
+
+    scatter_origin = rec.p;
+    scatter_pdf = 0;
+    if (sampled_lights)
+      mat.evaluate(rec, unit_vector(scattered.direction()), scatter_pdf);
+    r = scattered;
+    STATS_ADD(rays_by_depth[render_stats::depth_bucket(bounces)], 1);
+    if (!world.hit(r, interval(0, std::numeric_limits<real>::infinity()),
+                   rec)) {
+      STATS_ADD(paths_escaped, 1);
+      return radiance + throughput * (sky_brightness * background(r));
+    }
   }
+}
 
+colour camera::background(const ray &r) {
   CONST_VAR vec3 unit_direction = unit_vector(r.direction());
   CONST_VAR auto a = 0.5 * (unit_direction.y() + 1.0);
   return (1.0 - a) * colour(1.0, 1.0, 1.0) + a * colour(0.5, 0.7, 1.0);
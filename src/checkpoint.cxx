@@ -0,0 +1,227 @@
+#include "checkpoint.hpp"
+#include "camera.hpp"
+#include "fd_io.hpp"
+#include "rtweekend.hpp"
+#include "scenes.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr char checkpoint_magic[8] = {'R', 'T', 'C', 'K', 'P', 'T', '0', '2'};
+
+class checkpoint_header {
+public:
+  char magic[8];
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint64_t fingerprint;
+};
+
+class checkpoint_pixel {
+public:
+  double sum[3];
+  std::int64_t samples;
+};
+
+// 64-bit FNV-1a over the bytes of the values added.
+class fingerprint_hash {
+public:
+  std::uint64_t value = 0xcbf29ce484222325;
+
+  template <class T> void add(const T &x) {
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &x, sizeof(T));
+    for (CONST_VAR unsigned char byte : bytes) {
+      value ^= byte;
+      value *= 0x100000001b3;
+    }
+  }
+
+  void add_vector(const vec3 &v) {
+    for (int i = 0; i < 3; i++)
+      add(double(v[i]));
+  }
+};
+
+} // namespace
+
+std::uint64_t render_fingerprint(const camera &cam, const scene &s) {
+  fingerprint_hash hash;
+  hash.add(cam.aspect_ratio);
+  hash.add(cam.image_width);
+  hash.add(cam.max_depth);
+  hash.add(cam.roulette_depth);
+  hash.add(cam.vfov);
+  hash.add_vector(cam.lookfrom);
+  hash.add_vector(cam.lookat);
+  hash.add_vector(cam.vup);
+  hash.add(cam.defocus_angle);
+  hash.add(cam.focus_dist);
+  hash.add(cam.sky_brightness);
+  hash.add(cam.light_sampling);
+  hash.add(int(cam.sampling));
+  if (cam.sampling == sample_pattern::stratified ||
+      cam.sampling == sample_pattern::halton)
+    hash.add(cam.samples_per_pixel);
+
+  for (std::size_t i = 0; i < s.materials.size(); i++) {
+    CONST_VAR material_params params = s.materials[material_id(i)].params();
+    hash.add(int(params.kind));
+    for (CONST_VAR double value : params.values)
+      hash.add(value);
+  }
+  CONST_VAR sphere_set &spheres = *s.spheres;
+  for (std::size_t i = 0; i < spheres.size(); i++) {
+    hash.add_vector(spheres.center(i));
+    hash.add(double(spheres.radius(i)));
+    hash.add(spheres.mat(i));
+  }
+  return hash.value;
+}
+
+bool write_checkpoint(const framebuffer &image,
+                      const std::uint64_t fingerprint,
+                      const std::string &path) {
+  checkpoint_header header;
+  std::memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+  header.width = std::uint32_t(image.width());
+  header.height = std::uint32_t(image.height());
+  header.fingerprint = fingerprint;
+
+  std::vector<char> buffer(sizeof(header) + std::size_t(image.width()) *
+                                                image.height() *
+                                                sizeof(checkpoint_pixel));
+  std::memcpy(buffer.data(), &header, sizeof(header));
+  char *out = buffer.data() + sizeof(header);
+  for (int y = 0; y < image.height(); y++) {
+    for (int x = 0; x < image.width(); x++) {
+      CONST_VAR colour sum = image.sum(x, y);
+      CONST_VAR checkpoint_pixel pixel = {{sum.x(), sum.y(), sum.z()},
+                                          image.samples(x, y)};
+      std::memcpy(out, &pixel, sizeof(pixel));
+      out += sizeof(pixel);
+    }
+  }
+
+  CONST_VAR std::string temporary = path + ".tmp";
+  CONST_VAR int fd =
+      ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Cannot open " << temporary << ": " << std::strerror(errno)
+              << '\n';
+    return false;
+  }
+  // The data has to be on disk before the rename makes it the checkpoint.
+  bool ok = write_all(fd, buffer.data(), buffer.size()) && ::fsync(fd) == 0;
+  int error = ok ? 0 : errno;
+  if (::close(fd) != 0 && ok) {
+    ok = false;
+    error = errno;
+  }
+  if (ok && std::rename(temporary.c_str(), path.c_str()) != 0) {
+    ok = false;
+    error = errno;
+  }
+  if (!ok) {
+    std::cerr << "Cannot write " << path << ": " << std::strerror(error)
+              << '\n';
+    std::remove(temporary.c_str());
+  }
+  return ok;
+}
+
+bool read_checkpoint(const std::string &path, framebuffer &image,
+                     std::uint64_t &fingerprint) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    std::cerr << "Cannot open " << path << '\n';
+    return false;
+  }
+  checkpoint_header header;
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) != 0) {
+    std::cerr << path << " is not a checkpoint\n";
+    return false;
+  }
+
+  // Check the size against the file before trusting it with an allocation.
+  CONST_VAR std::uint32_t max_side = std::numeric_limits<int>::max();
+  if (header.width == 0 || header.height == 0 || header.width > max_side ||
+      header.height > max_side) {
+    std::cerr << path << " has an invalid image size\n";
+    return false;
+  }
+  CONST_VAR std::uint64_t num_pixels =
+      std::uint64_t(header.width) * header.height;
+  in.seekg(0, std::ios::end);
+  CONST_VAR std::streamoff file_size = in.tellg();
+  in.seekg(sizeof(header));
+  CONST_VAR std::uint64_t data_size = std::uint64_t(file_size) - sizeof(header);
+  if (!in || data_size % sizeof(checkpoint_pixel) != 0 ||
+      data_size / sizeof(checkpoint_pixel) != num_pixels) {
+    std::cerr << path << " does not match its image size\n";
+    return false;
+  }
+
+  CONST_VAR int width = int(header.width);
+  CONST_VAR int height = int(header.height);
+  std::vector<checkpoint_pixel> pixels(num_pixels);
+  if (!in.read(reinterpret_cast<char *>(pixels.data()),
+               std::streamsize(pixels.size() * sizeof(checkpoint_pixel)))) {
+    std::cerr << path << " is truncated\n";
+    return false;
+  }
+
+  image = framebuffer(width, height);
+  fingerprint = header.fingerprint;
+  std::size_t i = 0;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++, i++) {
+      const checkpoint_pixel &pixel = pixels[i];
+      image.set_samples(x, y,
+                        colour(pixel.sum[0], pixel.sum[1], pixel.sum[2]),
+                        int(pixel.samples));
+    }
+  }
+  return true;
+}
+
+checkpoint_writer::checkpoint_writer(const std::string &path,
+                                     const double interval,
+                                     const std::uint64_t fingerprint,
+                                     const framebuffer &start)
+    : path(path), interval(interval), fingerprint(fingerprint),
+      snapshot(start),
+      last_write(std::chrono::steady_clock::now()) {}
+
+void checkpoint_writer::add_finished(const framebuffer &image, const int x0,
+                                     const int y0, const int x1,
+                                     const int y1) {
+  std::lock_guard<std::mutex> guard(lock);
+  for (int y = y0; y < y1; y++)
+    for (int x = x0; x < x1; x++)
+      snapshot.set_samples(x, y, image.sum(x, y), image.samples(x, y));
+
+  CONST_VAR std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - last_write;
+  if (elapsed.count() >= interval) {
+    write_checkpoint(snapshot, fingerprint, path);
+    last_write = std::chrono::steady_clock::now();
+  }
+}
+
+bool checkpoint_writer::write() {
+  std::lock_guard<std::mutex> guard(lock);
+  last_write = std::chrono::steady_clock::now();
+  return write_checkpoint(snapshot, fingerprint, path);
+}
@@ -0,0 +1,221 @@
+#include "denoise.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// One number per pixel, row by row. Every quantity the filter reads has a
+// plane of its own, so that its inner loops run over contiguous floats,
+// which the compiler can vectorise; single precision is plenty for pixel
+// values and doubles the lanes.
+using plane = std::vector<float>;
+
+// Colour, albedo or normal, one plane per component.
+class planes {
+public:
+  plane c[3];
+
+  explicit planes(const std::size_t size)
+      : c{plane(size), plane(size), plane(size)} {}
+};
+
+// Weights of the taps along each axis: the B3 spline (1 4 6 4 1) / 16.
+constexpr float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4,
+                             1.0f / 16};
+
+// e^-x for x >= 0, to 2e-4 relative, which is plenty for weights, and 0
+// beyond 20, where it would only feed denormals into the sums. Unlike
+// std::exp it has no calls or branches, so loops over it vectorise.
+inline float exp_minus(const float x) {
+  // e^-x = 2^-t = 2^-i * 2^-f, with i the whole part of t and 0 <= f < 1.
+  CONST_VAR float t = std::min(x, 20.0f) * 1.44269504f;
+  CONST_VAR std::int32_t i = std::int32_t(t);
+  CONST_VAR float f = t - float(i);
+  // 2^-f on [0, 1) by a cubic fitted to it by least squares.
+  CONST_VAR float p =
+      1 + f * (-0.69161150f + f * (0.23139167f + f * -0.03986831f));
+  CONST_VAR std::int32_t bits = (127 - i) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return x < 20 ? p * scale : 0.0f;
+}
+
+// Difference of a at pixels p and q, squared.
+inline float distance_2(const planes &a, const std::size_t p,
+                        const std::size_t q) {
+  CONST_VAR float d0 = a.c[0][p] - a.c[0][q];
+  CONST_VAR float d1 = a.c[1][p] - a.c[1][q];
+  CONST_VAR float d2 = a.c[2][p] - a.c[2][q];
+  return d0 * d0 + d1 * d1 + d2 * d2;
+}
+
+inline float luminance(const planes &a, const std::size_t p) {
+  return 0.2126f * a.c[0][p] + 0.7152f * a.c[1][p] + 0.0722f * a.c[2][p];
+}
+
+// What the passes share.
+class filter_state {
+public:
+  int width, height;
+  planes albedo, normal;
+  float inv_normal, inv_albedo; // 1 / sigma^2
+  float sigma_colour_2;
+
+  filter_state(const int width, const int height)
+      : width(width), height(height),
+        albedo(std::size_t(width) * height),
+        normal(std::size_t(width) * height) {}
+
+  // Weight of the features of q against those of p.
+  float feature_weight(const std::size_t p, const std::size_t q) const {
+    return exp_minus(distance_2(normal, p, q) * inv_normal +
+                     distance_2(albedo, p, q) * inv_albedo);
+  }
+};
+
+// Spatial estimate of the variance of the gamma corrected luminance of row
+// y, from the 3x3 neighbourhood of each pixel weighted by its features.
+void estimate_variance(const filter_state &f, const int y,
+                       const planes &gamma, plane &variance) {
+  for (int x = 0; x < f.width; x++) {
+    CONST_VAR std::size_t p = std::size_t(y) * f.width + x;
+    float sum_w = 0, sum = 0, sum_2 = 0;
+    for (int yy = std::max(0, y - 1); yy <= std::min(f.height - 1, y + 1);
+         yy++) {
+      for (int xx = std::max(0, x - 1); xx <= std::min(f.width - 1, x + 1);
+           xx++) {
+        CONST_VAR std::size_t q = std::size_t(yy) * f.width + xx;
+        CONST_VAR float w = f.feature_weight(p, q);
+        CONST_VAR float l = luminance(gamma, q);
+        sum_w += w;
+        sum += w * l;
+        sum_2 += w * l * l;
+      }
+    }
+    CONST_VAR float mean = sum / sum_w;
+    variance[p] = std::max(0.0f, sum_2 / sum_w - mean * mean);
+  }
+}
+
+// One pass of the filter over row y of colour and its variance into result
+// and result_variance, with taps step pixels apart. The colour weights
+// compare gamma corrected colours, in which differences are what the eye
+// sees, against the pixel's noise, so that noise is smoothed away but edges
+// that stand out of it are not.
+void filter_row(const filter_state &f, const int y, const int step,
+                const planes &colour_in, const planes &gamma,
+                const plane &variance, planes &result,
+                plane &result_variance) {
+  CONST_VAR int width = f.width;
+  std::vector<float> sums[3] = {std::vector<float>(width),
+                                std::vector<float>(width),
+                                std::vector<float>(width)};
+  std::vector<float> weights(width), variances(width), inv_colour(width);
+  CONST_VAR std::size_t row = std::size_t(y) * width;
+  for (int x = 0; x < width; x++)
+    inv_colour[x] = 1 / (f.sigma_colour_2 * variance[row + x] + 1e-6f);
+
+  for (int ky = 0; ky < 5; ky++) {
+    CONST_VAR int yy = y + (ky - 2) * step;
+    if (yy < 0 || yy >= f.height)
+      continue;
+    for (int kx = 0; kx < 5; kx++) {
+      // Taps that fall outside the image are left out, and the weights
+      // renormalise what remains.
+      CONST_VAR int offset = (kx - 2) * step;
+      CONST_VAR int x0 = std::max(0, -offset);
+      CONST_VAR int x1 = std::min(width, width - offset);
+      CONST_VAR float k = kernel[ky] * kernel[kx];
+      CONST_VAR std::size_t tap_row = std::size_t(yy) * width + offset;
+      for (int x = x0; x < x1; x++) {
+        CONST_VAR std::size_t p = row + x;
+        CONST_VAR std::size_t q = tap_row + x;
+        CONST_VAR float w =
+            k * exp_minus(distance_2(gamma, p, q) * inv_colour[x] +
+                          distance_2(f.normal, p, q) * f.inv_normal +
+                          distance_2(f.albedo, p, q) * f.inv_albedo);
+        sums[0][x] += w * colour_in.c[0][q];
+        sums[1][x] += w * colour_in.c[1][q];
+        sums[2][x] += w * colour_in.c[2][q];
+        weights[x] += w;
+        variances[x] += w * w * variance[q];
+      }
+    }
+  }
+
+  // The centre tap always counts, so no weight is 0.
+  for (int x = 0; x < width; x++) {
+    for (int c = 0; c < 3; c++)
+      result.c[c][row + x] = sums[c][x] / weights[x];
+    result_variance[row + x] = variances[x] / (weights[x] * weights[x]);
+  }
+}
+
+} // namespace
+
+framebuffer denoise(const framebuffer &image,
+                    const denoise_settings &settings) {
+  CONST_VAR int width = image.width();
+  CONST_VAR int height = image.height();
+  CONST_VAR std::size_t size = std::size_t(width) * height;
+
+  filter_state f(width, height);
+  planes colour_in(size);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      CONST_VAR std::size_t p = std::size_t(y) * width + x;
+      CONST_VAR colour pixel = image.pixel(x, y);
+      CONST_VAR colour a = image.albedo(x, y);
+      CONST_VAR vec3 n = image.normal(x, y);
+      for (int c = 0; c < 3; c++) {
+        colour_in.c[c][p] = float(pixel[c]);
+        f.albedo.c[c][p] = float(a[c]);
+        f.normal.c[c][p] = float(n[c]);
+      }
+    }
+  }
+  f.inv_normal = float(1 / (settings.sigma_normal * settings.sigma_normal));
+  f.inv_albedo = float(1 / (settings.sigma_albedo * settings.sigma_albedo));
+  f.sigma_colour_2 = float(settings.sigma_colour * settings.sigma_colour);
+
+  thread_pool pool(settings.num_threads > 0 ? settings.num_threads
+                                            : thread_pool::default_threads());
+  planes gamma(size), result(size);
+  plane variance(size), result_variance(size);
+  auto update_gamma = [&] {
+    for (int c = 0; c < 3; c++)
+      for (std::size_t p = 0; p < size; p++)
+        gamma.c[c][p] = std::sqrt(std::max(colour_in.c[c][p], 0.0f));
+  };
+  update_gamma();
+  pool.parallel_for(height, [&](int, int y) {
+    estimate_variance(f, y, gamma, variance);
+  });
+  for (int iteration = 0; iteration < settings.iterations; iteration++) {
+    if (iteration > 0)
+      update_gamma();
+    CONST_VAR int step = 1 << iteration;
+    pool.parallel_for(height, [&](int, int y) {
+      filter_row(f, y, step, colour_in, gamma, variance, result,
+                 result_variance);
+    });
+    std::swap(colour_in, result);
+    std::swap(variance, result_variance);
+  }
+
+  framebuffer filtered(width, height);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      CONST_VAR std::size_t p = std::size_t(y) * width + x;
+      filtered.add_samples(
+          x, y, colour(colour_in.c[0][p], colour_in.c[1][p], colour_in.c[2][p]),
+          1);
+    }
+  }
+  return filtered;
+}
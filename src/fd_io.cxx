@@ -0,0 +1,33 @@
+#include "fd_io.hpp"
+#include "rtweekend.hpp"
+
+#include <cerrno>
+#include <unistd.h>
+
+bool read_all(const int fd, void *data, std::size_t size) {
+  char *next = static_cast<char *>(data);
+  while (size > 0) {
+    CONST_VAR ssize_t n = ::read(fd, next, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    next += n;
+    size -= std::size_t(n);
+  }
+  return true;
+}
+
+bool write_all(const int fd, const void *data, std::size_t size) {
+  const char *next = static_cast<const char *>(data);
+  while (size > 0) {
+    CONST_VAR ssize_t n = ::write(fd, next, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    next += n;
+    size -= std::size_t(n);
+  }
+  return true;
+}
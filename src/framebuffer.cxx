@@ -0,0 +1,159 @@
+#include "framebuffer.hpp"
+
+#include <algorithm>
+
+framebuffer::framebuffer() {}
+
+framebuffer::framebuffer(const int width, const int height)
+    : image_width(width), image_height(height),
+      sums(std::size_t(width) * height), counts(std::size_t(width) * height) {}
+
+int framebuffer::width() const { return image_width; }
+
+int framebuffer::height() const { return image_height; }
+
+void framebuffer::add_samples(const int x, const int y, const colour &sum,
+                              const int count) {
+  CONST_VAR std::size_t i = index(x, y);
+  sums[i] += sum;
+  counts[i] += count;
+}
+
+colour framebuffer::pixel(const int x, const int y) const {
+  CONST_VAR std::size_t i = index(x, y);
+  if (counts[i] == 0)
+    return colour(0, 0, 0);
+  return (1.0 / counts[i]) * sums[i];
+}
+
+int framebuffer::samples(const int x, const int y) const {
+  return counts[index(x, y)];
+}
+
+colour framebuffer::sum(const int x, const int y) const {
+  return sums[index(x, y)];
+}
+
+void framebuffer::set_samples(const int x, const int y, const colour &sum,
+                              const int count) {
+  CONST_VAR std::size_t i = index(x, y);
+  sums[i] = sum;
+  counts[i] = count;
+}
+
+void framebuffer::enable_costs() {
+  costs.assign(std::size_t(image_width) * image_height, 0.0);
+}
+
+bool framebuffer::has_costs() const { return !costs.empty(); }
+
+void framebuffer::add_cost(const int x, const int y, const double seconds) {
+  costs[index(x, y)] += seconds;
+}
+
+double framebuffer::cost(const int x, const int y) const {
+  return costs.empty() ? 0 : costs[index(x, y)];
+}
+
+void framebuffer::enable_features() {
+  albedos.assign(std::size_t(image_width) * image_height, colour(0, 0, 0));
+  normals.assign(std::size_t(image_width) * image_height, vec3(0, 0, 0));
+}
+
+bool framebuffer::has_features() const { return !albedos.empty(); }
+
+void framebuffer::set_features(const int x, const int y, const colour &albedo,
+                               const vec3 &normal) {
+  CONST_VAR std::size_t i = index(x, y);
+  albedos[i] = albedo;
+  normals[i] = normal;
+}
+
+colour framebuffer::albedo(const int x, const int y) const {
+  return albedos.empty() ? colour(0, 0, 0) : albedos[index(x, y)];
+}
+
+vec3 framebuffer::normal(const int x, const int y) const {
+  return normals.empty() ? vec3(0, 0, 0) : normals[index(x, y)];
+}
+
+std::size_t framebuffer::index(const int x, const int y) const {
+  return std::size_t(y) * image_width + x;
+}
+
+framebuffer sample_heatmap(const framebuffer &image) {
+  int fewest = std::numeric_limits<int>::max();
+  int most = 0;
+  for (int y = 0; y < image.height(); y++) {
+    for (int x = 0; x < image.width(); x++) {
+      fewest = std::min(fewest, image.samples(x, y));
+      most = std::max(most, image.samples(x, y));
+    }
+  }
+
+  framebuffer heatmap(image.width(), image.height());
+  CONST_VAR double range = most > fewest ? most - fewest : 1;
+  for (int y = 0; y < image.height(); y++)
+    for (int x = 0; x < image.width(); x++)
+      heatmap.add_samples(
+          x, y, heatmap_colour((image.samples(x, y) - fewest) / range), 1);
+  return heatmap;
+}
+
+framebuffer cost_heatmap(const framebuffer &image) {
+  // The scale spans the 0.1% to 99.9% quantiles of the timed pixels, so that
+  // a few pixels interrupted by the scheduler do not flatten it.
+  std::vector<double> costs;
+  for (int y = 0; y < image.height(); y++)
+    for (int x = 0; x < image.width(); x++)
+      if (image.cost(x, y) > 0)
+        costs.push_back(std::log(image.cost(x, y)));
+
+  double low = 0;
+  double high = 0;
+  if (!costs.empty()) {
+    CONST_VAR std::size_t last = costs.size() - 1;
+    std::nth_element(costs.begin(), costs.begin() + last / 1000, costs.end());
+    low = costs[last / 1000];
+    std::nth_element(costs.begin(), costs.end() - 1 - last / 1000,
+                     costs.end());
+    high = costs[last - last / 1000];
+  }
+
+  framebuffer heatmap(image.width(), image.height());
+  CONST_VAR double range = high > low ? high - low : 1;
+  for (int y = 0; y < image.height(); y++) {
+    for (int x = 0; x < image.width(); x++) {
+      CONST_VAR double cost = image.cost(x, y);
+      CONST_VAR double t = cost > 0 ? (std::log(cost) - low) / range : 0;
+      heatmap.add_samples(x, y, heatmap_colour(t), 1);
+    }
+  }
+  return heatmap;
+}
+
+framebuffer albedo_map(const framebuffer &image) {
+  framebuffer map(image.width(), image.height());
+  for (int y = 0; y < image.height(); y++)
+    for (int x = 0; x < image.width(); x++)
+      map.add_samples(x, y, image.albedo(x, y), 1);
+  return map;
+}
+
+framebuffer normal_map(const framebuffer &image) {
+  framebuffer map(image.width(), image.height());
+  for (int y = 0; y < image.height(); y++)
+    for (int x = 0; x < image.width(); x++)
+      map.add_samples(x, y, 0.5 * (image.normal(x, y) + vec3(1, 1, 1)), 1);
+  return map;
+}
+
+colour heatmap_colour(const double t) {
+  static const colour stops[] = {colour(0, 0, 1), colour(0, 1, 0),
+                                 colour(1, 1, 0), colour(1, 0, 0)};
+  constexpr int last = 3;
+  CONST_VAR double position = std::fmin(std::fmax(t, 0.0), 1.0) * last;
+  CONST_VAR int stop = std::min(int(position), last - 1);
+  CONST_VAR double f = position - stop;
+  return (1 - f) * stops[stop] + f * stops[stop + 1];
+}
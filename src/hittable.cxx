@@ -1,5 +1,6 @@
 
 #include "hittable.hpp"
+#include "interval.hpp"
 
 void hit_record::set_face_normal(const ray &r, const vec3 &outward_normal) {
   // Sets the hit record normal vector.
@@ -8,3 +9,35 @@ void hit_record::set_face_normal(const ray &r, const vec3 &outward_normal) {
   front_face = dot(r.direction(), outward_normal) < 0;
   normal = front_face ? outward_normal : -outward_normal;
 }
+
+point3 hit_record::spawn_origin(const vec3 &direction) const {
+  return dot(direction, normal) > 0 ? p + error * normal : p - error * normal;
+}
+
+bool hittable::hit(const ray &r, interval ray_t, hit_record &rec) const {
+  hit_candidate candidate;
+  if (!intersect(r, ray_t, candidate))
+    return false;
+  candidate.object->finalize(r, candidate, rec);
+  return true;
+}
+
+bool hittable::occluded(const ray &r, interval ray_t) const {
+  hit_candidate candidate;
+  return intersect(r, ray_t, candidate);
+}
+
+unsigned hittable::intersect_packet(ray_packet &packet,
+                                    hit_candidate *hits) const {
+  unsigned hit_lanes = 0;
+  for (int lane = 0; lane < ray_packet::size; lane++) {
+    if (!(packet.active & (1u << lane)))
+      continue;
+    if (intersect(packet.get(lane), interval(packet.t_min, packet.t_max[lane]),
+                  hits[lane])) {
+      packet.t_max[lane] = hits[lane].t;
+      hit_lanes |= 1u << lane;
+    }
+  }
+  return hit_lanes;
+}
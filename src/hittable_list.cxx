@@ -3,24 +3,61 @@
 hittable_list::hittable_list() {}
 hittable_list::hittable_list(std::shared_ptr<hittable> object) { add(object); }
 
-void hittable_list::clear() { objects.clear(); }
+void hittable_list::clear() {
+  objects.clear();
+  owners.clear();
+  bbox = aabb();
+}
 
 void hittable_list::add(std::shared_ptr<hittable> object) {
+  add(object.get());
+  owners.push_back(std::move(object));
+}
+
+void hittable_list::add(const hittable *object) {
   objects.push_back(object);
+  bbox = aabb(bbox, object->bounding_box());
 }
 
-bool hittable_list::hit(const ray &r, interval ray_t, hit_record &rec) const {
-  hit_record temp_rec;
+const std::vector<std::shared_ptr<const hittable>> &
+hittable_list::owned() const {
+  return owners;
+}
+
+bool hittable_list::intersect(const ray &r, interval ray_t,
+                              hit_candidate &hit) const {
   bool hit_anything = false;
-  auto closest_so_far = ray_t.max;
 
+  // Objects only write to hit when they find one inside the interval, which
+  // shrinks to each new hit, so hit ends up holding the closest one.
   for (CONST_VAR auto &object : objects) {
-    if (object->hit(r, interval(ray_t.min, closest_so_far), temp_rec)) {
+    if (object->intersect(r, ray_t, hit)) {
       hit_anything = true;
-      closest_so_far = temp_rec.t;
-      rec = temp_rec;
+      ray_t.max = hit.t;
     }
   }
 
   return hit_anything;
-}
\ No newline at end of file
+}
+
+bool hittable_list::occluded(const ray &r, interval ray_t) const {
+  for (CONST_VAR auto &object : objects)
+    if (object->occluded(r, ray_t))
+      return true;
+  return false;
+}
+
+void hittable_list::finalize(const ray &r, const hit_candidate &hit,
+                             hit_record &rec) const {
+  hit.object->finalize(r, hit, rec);
+}
+
+unsigned hittable_list::intersect_packet(ray_packet &packet,
+                                         hit_candidate *hits) const {
+  unsigned hit_lanes = 0;
+  for (CONST_VAR auto &object : objects)
+    hit_lanes |= object->intersect_packet(packet, hits);
+  return hit_lanes;
+}
+
+aabb hittable_list::bounding_box() const { return bbox; }
@@ -0,0 +1,216 @@
+#include "image_writer.hpp"
+#include "fd_io.hpp"
+#include "interval.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Translates a linear component to a gamma 2 byte, as the P3 output always
+// has.
+inline int to_byte(const double linear_component) {
+  static const interval intensity(0.000, 0.999);
+  return int(256 * intensity.clamp(linear_to_gamma(linear_component)));
+}
+
+inline int decimal_digits(const int byte) {
+  return byte < 10 ? 1 : (byte < 100 ? 2 : 3);
+}
+
+// Writes byte in decimal and returns the position after it.
+inline char *write_decimal(char *out, const int byte) {
+  if (byte >= 100)
+    *out++ = char('0' + byte / 100);
+  if (byte >= 10)
+    *out++ = char('0' + byte / 10 % 10);
+  *out++ = char('0' + byte % 10);
+  return out;
+}
+
+std::string header(const framebuffer &image, const image_format format) {
+  CONST_VAR std::string size =
+      std::to_string(image.width()) + ' ' + std::to_string(image.height());
+  switch (format) {
+  case image_format::p3:
+    return "P3\n" + size + "\n255\n";
+  case image_format::p6:
+    return "P6\n" + size + "\n255\n";
+  case image_format::pfm:
+    // A negative scale marks little-endian floats.
+    return "PF\n" + size + "\n-1.0\n";
+  }
+  return "";
+}
+
+void encode_p3(const framebuffer &image, char *out) {
+  for (int y = 0; y < image.height(); y++) {
+    for (int x = 0; x < image.width(); x++) {
+      CONST_VAR colour c = image.pixel(x, y);
+      out = write_decimal(out, to_byte(c.x()));
+      *out++ = ' ';
+      out = write_decimal(out, to_byte(c.y()));
+      *out++ = ' ';
+      out = write_decimal(out, to_byte(c.z()));
+      *out++ = '\n';
+    }
+  }
+}
+
+void encode_p6(const framebuffer &image, char *out) {
+  for (int y = 0; y < image.height(); y++) {
+    for (int x = 0; x < image.width(); x++) {
+      CONST_VAR colour c = image.pixel(x, y);
+      *out++ = char(to_byte(c.x()));
+      *out++ = char(to_byte(c.y()));
+      *out++ = char(to_byte(c.z()));
+    }
+  }
+}
+
+void encode_pfm(const framebuffer &image, char *out) {
+  // PFM stores the bottom row first.
+  for (int y = image.height() - 1; y >= 0; y--) {
+    for (int x = 0; x < image.width(); x++) {
+      CONST_VAR colour c = image.pixel(x, y);
+      for (int k = 0; k < 3; k++) {
+        CONST_VAR float value = float(c[k]);
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int byte = 0; byte < 4; byte++)
+          *out++ = char((bits >> (8 * byte)) & 0xff);
+      }
+    }
+  }
+}
+
+bool write_mapped(const framebuffer &image, const image_format format,
+                  const int fd, const std::size_t size) {
+  if (::ftruncate(fd, off_t(size)) != 0)
+    return false;
+  if (size == 0)
+    return true;
+  void *mapping = ::mmap(nullptr, size, PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED)
+    return false;
+  encode_image(image, format, static_cast<char *>(mapping));
+  return ::munmap(mapping, size) == 0;
+}
+
+} // namespace
+
+bool parse_image_format(const std::string &name, image_format &format) {
+  if (name == "p3")
+    format = image_format::p3;
+  else if (name == "p6")
+    format = image_format::p6;
+  else if (name == "pfm")
+    format = image_format::pfm;
+  else
+    return false;
+  return true;
+}
+
+std::size_t encoded_size(const framebuffer &image, const image_format format) {
+  CONST_VAR std::size_t pixels = std::size_t(image.width()) * image.height();
+  std::size_t size = header(image, format).size();
+  switch (format) {
+  case image_format::p3:
+    // Three numbers of one to three digits, two spaces and a newline.
+    for (int y = 0; y < image.height(); y++) {
+      for (int x = 0; x < image.width(); x++) {
+        CONST_VAR colour c = image.pixel(x, y);
+        size += decimal_digits(to_byte(c.x())) +
+                decimal_digits(to_byte(c.y())) +
+                decimal_digits(to_byte(c.z())) + 3;
+      }
+    }
+    break;
+  case image_format::p6:
+    size += 3 * pixels;
+    break;
+  case image_format::pfm:
+    size += 3 * sizeof(float) * pixels;
+    break;
+  }
+  return size;
+}
+
+void encode_image(const framebuffer &image, const image_format format,
+                  char *out) {
+  CONST_VAR std::string head = header(image, format);
+  std::memcpy(out, head.data(), head.size());
+  out += head.size();
+  switch (format) {
+  case image_format::p3:
+    encode_p3(image, out);
+    break;
+  case image_format::p6:
+    encode_p6(image, out);
+    break;
+  case image_format::pfm:
+    encode_pfm(image, out);
+    break;
+  }
+}
+
+bool write_image(const framebuffer &image, const image_format format,
+                 const std::string &path, const bool use_mmap) {
+  CONST_VAR std::size_t size = encoded_size(image, format);
+  CONST_VAR bool to_stdout = (path == "-");
+
+  int fd = STDOUT_FILENO;
+  if (!to_stdout) {
+    CONST_VAR int access = use_mmap ? O_RDWR : O_WRONLY;
+    fd = ::open(path.c_str(), access | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      std::cerr << "Cannot open " << path << ": " << std::strerror(errno)
+                << '\n';
+      return false;
+    }
+  }
+
+  bool ok;
+  if (use_mmap && !to_stdout) {
+    ok = write_mapped(image, format, fd, size);
+  } else {
+    // Encode the whole image first so it goes out in a single write.
+    std::vector<char> buffer(size);
+    encode_image(image, format, buffer.data());
+    ok = write_all(fd, buffer.data(), size);
+  }
+  int error = ok ? 0 : errno;
+  if (!to_stdout && ::close(fd) != 0 && ok) {
+    ok = false;
+    error = errno;
+  }
+
+  if (!ok)
+    std::cerr << "Cannot write " << (to_stdout ? "standard output" : path)
+              << ": " << std::strerror(error) << '\n';
+  return ok;
+}
+
+bool replace_image(const framebuffer &image, const image_format format,
+                   const std::string &path) {
+  if (path == "-")
+    return write_image(image, format, path, false);
+  CONST_VAR std::string temporary = path + ".tmp";
+  if (!write_image(image, format, temporary, false))
+    return false;
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::cerr << "Cannot replace " << path << ": " << std::strerror(errno)
+              << '\n';
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
@@ -2,19 +2,23 @@
 #include "interval.hpp"
 
 interval::interval()
-    : min(+std::numeric_limits<double>::infinity()),
-      max(-std::numeric_limits<double>::infinity()) {
+    : min(+std::numeric_limits<real>::infinity()),
+      max(-std::numeric_limits<real>::infinity()) {
 } // Default interval is empty
 
-interval::interval(const double min, const double max) : min(min), max(max) {}
+interval::interval(const real min, const real max) : min(min), max(max) {}
 
-double interval::size() const { return max - min; }
+interval::interval(const interval &a, const interval &b)
+    : min(a.min <= b.min ? a.min : b.min),
+      max(a.max >= b.max ? a.max : b.max) {}
 
-bool interval::contains(const double x) const { return min <= x && x <= max; }
+real interval::size() const { return max - min; }
 
-bool interval::surrounds(const double x) const { return min < x && x < max; }
+bool interval::contains(const real x) const { return min <= x && x <= max; }
 
-double interval::clamp(const double x) const {
+bool interval::surrounds(const real x) const { return min < x && x < max; }
+
+real interval::clamp(const real x) const {
   if (x < min)
     return min;
   if (x > max)
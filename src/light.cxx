@@ -0,0 +1,124 @@
+#include "light.hpp"
+#include "interval.hpp"
+#include "render_stats.hpp"
+
+#include <algorithm>
+#include <limits>
+
+void light_list::add(const point3 &center, const real radius,
+                     const material_id mat, const colour &emission) {
+  lights.push_back({center, radius, mat, emission});
+}
+
+void light_list::clear() { lights.clear(); }
+
+bool light_list::empty() const { return lights.empty(); }
+
+std::size_t light_list::size() const { return lights.size(); }
+
+double light_list::cone_pdf(const sphere_light &l, const point3 &p) {
+  CONST_VAR double distance_2 = (l.center - p).length_squared();
+  CONST_VAR double radius_2 = double(l.radius) * l.radius;
+  if (distance_2 <= radius_2)
+    return 0;
+  // 1 - cos(theta_max), written so that it keeps its precision for small
+  // and distant lights.
+  CONST_VAR double sin_2_max = radius_2 / distance_2;
+  CONST_VAR double cos_max = std::sqrt(1 - sin_2_max);
+  return 1 / (2 * pi * (sin_2_max / (1 + cos_max)));
+}
+
+bool light_list::sample(const point3 &p, const double choice,
+                        const sample_2d &u, light_sample &result) const {
+  CONST_VAR std::size_t index =
+      std::min(std::size_t(choice * lights.size()), lights.size() - 1);
+  const sphere_light &l = lights[index];
+  CONST_VAR vec3 to_center = l.center - p;
+  CONST_VAR double distance_2 = to_center.length_squared();
+  CONST_VAR double radius_2 = double(l.radius) * l.radius;
+  if (distance_2 <= radius_2)
+    return false;
+
+  // A direction uniformly over the cone around the light's centre.
+  CONST_VAR double sin_2_max = radius_2 / distance_2;
+  CONST_VAR double one_minus_cos_max =
+      sin_2_max / (1 + std::sqrt(1 - sin_2_max));
+  CONST_VAR double cos_theta = 1 - u.u * one_minus_cos_max;
+  CONST_VAR double sin_theta =
+      std::sqrt(std::fmax(0.0, 1 - cos_theta * cos_theta));
+  CONST_VAR double phi = 2 * pi * u.v;
+
+  // Orthonormal basis around the axis of the cone (Duff et al., "Building
+  // an Orthonormal Basis, Revisited", 2017).
+  CONST_VAR vec3 w = to_center / std::sqrt(distance_2);
+  CONST_VAR double sign = std::copysign(1.0, double(w.z()));
+  CONST_VAR double a = -1 / (sign + w.z());
+  CONST_VAR double b = w.x() * w.y() * a;
+  CONST_VAR vec3 s(1 + sign * w.x() * w.x() * a, sign * b, -sign * w.x());
+  CONST_VAR vec3 t(b, sign + w.y() * w.y() * a, -w.y());
+  result.direction = cos_theta * w + (sin_theta * std::cos(phi)) * s +
+                     (sin_theta * std::sin(phi)) * t;
+
+  // Nearer root of the ray through the sphere; rounding may leave a
+  // direction at the rim just outside it, which counts as grazing it. The
+  // intersection tests round differently and can find the sphere a few ulps
+  // of the distance nearer (far more near the rim), so the shadow ray stops
+  // well short of it.
+  CONST_VAR double h = dot(result.direction, to_center);
+  CONST_VAR double discriminant = h * h - (distance_2 - radius_2);
+  result.distance = (h - std::sqrt(std::fmax(0.0, discriminant))) *
+                    (1 - std::sqrt(std::numeric_limits<real>::epsilon()));
+  result.emission = l.emission;
+  result.pdf = 1 / (2 * pi * one_minus_cos_max) / lights.size();
+  return true;
+}
+
+double light_list::pdf(const point3 &p, const hit_record &rec) const {
+  // rec.p lies on its sphere to within rec.error.
+  for (CONST_VAR auto &l : lights) {
+    if (l.mat == rec.mat &&
+        std::fabs((rec.p - l.center).length() - l.radius) <= rec.error)
+      return cone_pdf(l, p) / lights.size();
+  }
+  return 0;
+}
+
+double power_heuristic(const double pdf, const double other_pdf) {
+  CONST_VAR double pdf_2 = pdf * pdf;
+  return pdf_2 / (pdf_2 + other_pdf * other_pdf);
+}
+
+colour sample_direct_light(const hittable &world, const light_list &lights,
+                           const material &mat, const hit_record &rec,
+                           sampler &gen) {
+  // Only directions on the side of the normal let light in, so the shadow
+  // ray starts off the surface on that side, and the light is sampled from
+  // there so that its distance is measured along the shadow ray itself.
+  CONST_VAR point3 origin = rec.p + rec.error * rec.normal;
+  light_sample light;
+  if (!lights.sample(origin, gen.light_1d(), gen.light_2d(), light))
+    return colour(0, 0, 0);
+  double scatter_pdf;
+  CONST_VAR colour response = mat.evaluate(rec, light.direction, scatter_pdf);
+  if (scatter_pdf <= 0)
+    return colour(0, 0, 0);
+
+  STATS_ADD(shadow_rays, 1);
+  CONST_VAR ray shadow(origin, light.direction);
+  if (world.occluded(shadow, interval(0, light.distance))) {
+    STATS_ADD(shadow_rays_occluded, 1);
+    return colour(0, 0, 0);
+  }
+  return (power_heuristic(light.pdf, scatter_pdf) / light.pdf) * response *
+         light.emission;
+}
+
+colour emitted_light(const light_list &lights, const material &mat,
+                     const hit_record &rec, const point3 &from,
+                     const double scatter_pdf) {
+  if (!rec.front_face)
+    return colour(0, 0, 0);
+  if (scatter_pdf <= 0)
+    return mat.emission();
+  return power_heuristic(scatter_pdf, lights.pdf(from, rec)) * mat.emission();
+}
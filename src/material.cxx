@@ -1,46 +1,66 @@
 
 
 #include "material.hpp"
-bool material::scatter(const ray &r_in [[maybe_unused]],
-                       const hit_record &rec [[maybe_unused]],
-                       colour &attenuation [[maybe_unused]],
-                       ray &scattered [[maybe_unused]]) const {
-  return false;
-}
+#include "render_stats.hpp"
 
 lambertian::lambertian(const colour &albedo) : albedo(albedo) {}
 
 bool lambertian::scatter(const ray &r_in [[maybe_unused]],
                          const hit_record &rec, colour &attenuation,
-                         ray &scattered) const {
-  auto scatter_direction = rec.normal + random_unit_vector();
+                         ray &scattered, sampler &gen) const {
+  STATS_ADD(scatters[int(material_kind::lambertian)], 1);
+  // A point on the unit sphere around the tip of the normal is a
+  // cosine-distributed direction about the normal.
+  CONST_VAR sample_2d on_sphere = gen.next_2d();
+  auto scatter_direction =
+      rec.normal + square_to_sphere(on_sphere.u, on_sphere.v);
 
   // Catch degenerate scatter direction
   if (scatter_direction.near_zero())
     scatter_direction = rec.normal;
 
-  scattered = ray(rec.p, scatter_direction);
+  scattered = ray(rec.spawn_origin(scatter_direction), scatter_direction);
   attenuation = albedo;
   return true;
 }
 
+colour lambertian::evaluate(const hit_record &rec, const vec3 &direction,
+                            double &pdf) const {
+  // scatter() picks directions with density cos / pi, and the surface
+  // scatters albedo / pi of the light from each.
+  CONST_VAR double cosine = dot(rec.normal, direction);
+  if (cosine <= 0) {
+    pdf = 0;
+    return colour(0, 0, 0);
+  }
+  pdf = cosine / pi;
+  return pdf * albedo;
+}
+
 metal::metal(const colour &albedo, double fuzz)
     : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
 
 bool metal::scatter(const ray &r_in, const hit_record &rec, colour &attenuation,
-                    ray &scattered) const {
+                    ray &scattered, sampler &gen) const {
+  STATS_ADD(scatters[int(material_kind::metal)], 1);
   vec3 reflected = reflect(r_in.direction(), rec.normal);
-  reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
-  scattered = ray(rec.p, reflected);
+  CONST_VAR sample_2d on_sphere = gen.next_2d();
+  reflected = unit_vector(reflected) +
+              (fuzz * square_to_sphere(on_sphere.u, on_sphere.v));
+  scattered = ray(rec.spawn_origin(reflected), reflected);
   attenuation = albedo;
-  return (dot(scattered.direction(), rec.normal) > 0);
+  CONST_VAR bool reflects = dot(scattered.direction(), rec.normal) > 0;
+  STATS_ADD(absorptions[int(material_kind::metal)], !reflects);
+  return reflects;
 }
 
 dielectric::dielectric(double refraction_index)
     : refraction_index(refraction_index) {}
 
 bool dielectric::scatter(const ray &r_in, const hit_record &rec,
-                         colour &attenuation, ray &scattered) const {
+                         colour &attenuation, ray &scattered,
+                         sampler &gen) const {
+  STATS_ADD(scatters[int(material_kind::dielectric)], 1);
   attenuation = colour(1.0, 1.0, 1.0);
   CONST_VAR double ri =
       rec.front_face ? (1.0 / refraction_index) : refraction_index;
@@ -54,12 +74,12 @@ bool dielectric::scatter(const ray &r_in, const hit_record &rec,
   CONST_VAR bool cannot_refract = ri * sin_theta > 1.0;
   vec3 direction;
 
-  if (cannot_refract || reflectance(cos_theta, ri) > random_double())
+  if (cannot_refract || reflectance(cos_theta, ri) > gen.next_1d())
     direction = reflect(unit_direction, rec.normal);
   else
     direction = refract(unit_direction, rec.normal, ri);
 
-  scattered = ray(rec.p, direction);
+  scattered = ray(rec.spawn_origin(direction), direction);
   return true;
 }
 
@@ -75,4 +95,127 @@ double dielectric::reflectance(const double cosine,
   CONST_VAR auto pow_5 = std::pow(1 - cosine, 5);
 #endif
   return r0_2 + (1 - r0_2) * pow_5;
-}
\ No newline at end of file
+}
+
+diffuse_light::diffuse_light(const colour &emit) : emit(emit) {}
+
+bool diffuse_light::scatter(const ray &r_in [[maybe_unused]],
+                            const hit_record &rec [[maybe_unused]],
+                            colour &attenuation [[maybe_unused]],
+                            ray &scattered [[maybe_unused]],
+                            sampler &gen [[maybe_unused]]) const {
+  STATS_ADD(scatters[int(material_kind::diffuse_light)], 1);
+  STATS_ADD(absorptions[int(material_kind::diffuse_light)], 1);
+  return false;
+}
+
+material::material(const lambertian &mat)
+    : tag(material_kind::lambertian), lambertian_mat(mat) {}
+
+material::material(const metal &mat)
+    : tag(material_kind::metal), metal_mat(mat) {}
+
+material::material(const dielectric &mat)
+    : tag(material_kind::dielectric), dielectric_mat(mat) {}
+
+material::material(const diffuse_light &mat)
+    : tag(material_kind::diffuse_light), diffuse_light_mat(mat) {}
+
+material::material(const material_params &params) : material(lambertian({})) {
+  const double *v = params.values;
+  switch (params.kind) {
+  case material_kind::lambertian:
+    *this = lambertian(colour(v[0], v[1], v[2]));
+    break;
+  case material_kind::metal:
+    *this = metal(colour(v[0], v[1], v[2]), v[3]);
+    break;
+  case material_kind::dielectric:
+    *this = dielectric(v[0]);
+    break;
+  case material_kind::diffuse_light:
+    *this = diffuse_light(colour(v[0], v[1], v[2]));
+    break;
+  }
+}
+
+material_kind material::kind() const { return tag; }
+
+material_params material::params() const {
+  material_params result = {tag, {0, 0, 0, 0}};
+  double *v = result.values;
+  switch (tag) {
+  case material_kind::lambertian:
+    for (int i = 0; i < 3; i++)
+      v[i] = lambertian_mat.albedo[i];
+    break;
+  case material_kind::metal:
+    for (int i = 0; i < 3; i++)
+      v[i] = metal_mat.albedo[i];
+    v[3] = metal_mat.fuzz;
+    break;
+  case material_kind::dielectric:
+    v[0] = dielectric_mat.refraction_index;
+    break;
+  case material_kind::diffuse_light:
+    for (int i = 0; i < 3; i++)
+      v[i] = diffuse_light_mat.emit[i];
+    break;
+  }
+  return result;
+}
+
+bool material::scatter(const ray &r_in, const hit_record &rec,
+                       colour &attenuation, ray &scattered,
+                       sampler &gen) const {
+  switch (tag) {
+  case material_kind::lambertian:
+    return lambertian_mat.scatter(r_in, rec, attenuation, scattered, gen);
+  case material_kind::metal:
+    return metal_mat.scatter(r_in, rec, attenuation, scattered, gen);
+  case material_kind::dielectric:
+    return dielectric_mat.scatter(r_in, rec, attenuation, scattered, gen);
+  case material_kind::diffuse_light:
+    return diffuse_light_mat.scatter(r_in, rec, attenuation, scattered, gen);
+  }
+  return false;
+}
+
+colour material::emission() const {
+  return tag == material_kind::diffuse_light ? diffuse_light_mat.emit
+                                             : colour(0, 0, 0);
+}
+
+colour material::albedo() const {
+  switch (tag) {
+  case material_kind::lambertian:
+    return lambertian_mat.albedo;
+  case material_kind::metal:
+    return metal_mat.albedo;
+  case material_kind::dielectric:
+  case material_kind::diffuse_light:
+    break;
+  }
+  return colour(1, 1, 1);
+}
+
+bool material::diffuse() const { return tag == material_kind::lambertian; }
+
+colour material::evaluate(const hit_record &rec, const vec3 &direction,
+                          double &pdf) const {
+  if (tag == material_kind::lambertian)
+    return lambertian_mat.evaluate(rec, direction, pdf);
+  pdf = 0;
+  return colour(0, 0, 0);
+}
+
+material_id material_table::add(const material &mat) {
+  materials.push_back(mat);
+  return material_id(materials.size() - 1);
+}
+
+const material &material_table::operator[](const material_id id) const {
+  return materials[id];
+}
+
+std::size_t material_table::size() const { return materials.size(); }
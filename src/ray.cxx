@@ -9,4 +9,4 @@ point3 &ray::origin() { return orig; }
 const vec3 &ray::direction() const { return dir; }
 vec3 &ray::direction() { return dir; }
 
-point3 ray::at(const double t) const { return orig + t * dir; }
+point3 ray::at(const real t) const { return orig + t * dir; }
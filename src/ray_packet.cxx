@@ -0,0 +1,17 @@
+#include "ray_packet.hpp"
+
+void ray_packet::set(const int lane, const ray &r, const real t_max) {
+  origin_x[lane] = r.origin().x();
+  origin_y[lane] = r.origin().y();
+  origin_z[lane] = r.origin().z();
+  direction_x[lane] = r.direction().x();
+  direction_y[lane] = r.direction().y();
+  direction_z[lane] = r.direction().z();
+  this->t_max[lane] = t_max;
+  active |= 1u << lane;
+}
+
+ray ray_packet::get(const int lane) const {
+  return ray(point3(origin_x[lane], origin_y[lane], origin_z[lane]),
+             vec3(direction_x[lane], direction_y[lane], direction_z[lane]));
+}
@@ -0,0 +1,340 @@
+#include "camera.hpp"
+#include "checkpoint.hpp"
+#include "fd_io.hpp"
+#include "render_stats.hpp"
+#include "rtweekend.hpp"
+#include "thread_pool.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <deque>
+#include <iostream>
+#include <memory>
+
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// A worker's answer to one tile index, followed by one pixel_reply for every
+// pixel of the tile, row by row.
+class tile_reply {
+public:
+  std::int32_t tile;
+  std::int32_t padding;
+  double seconds; // Time the worker took to render the tile
+  std::uint64_t counters[render_stats::num_counters];
+};
+
+class pixel_reply {
+public:
+  double sum[3];
+  double cost;
+  std::int64_t samples;
+};
+
+// A worker process and the coordinator's ends of the pipes to it.
+class worker {
+public:
+  pid_t pid = -1;          // -1 once the worker is gone for good
+  int requests = -1;       // Tile indices to the worker
+  int results = -1;        // Replies from the worker
+  std::deque<int> pending; // Tiles sent but not answered yet, in order
+};
+
+// Tiles each worker holds at once, so that it can start on the next one while
+// its last reply is read.
+constexpr std::size_t tiles_in_flight = 2;
+
+// Replacements for dead workers, per worker, before the coordinator gives up
+// on them.
+constexpr int restarts_per_worker = 2;
+
+void close_pipes(worker &w) {
+  if (w.requests >= 0)
+    close(w.requests);
+  if (w.results >= 0)
+    close(w.results);
+  w.requests = w.results = -1;
+}
+
+} // namespace
+
+framebuffer camera::render_processes(const hittable &world,
+                                     const material_table &materials,
+                                     const light_list &lights,
+                                     const int num_workers,
+                                     framebuffer image) {
+  this->materials = &materials;
+  this->lights = &lights;
+  initialize();
+
+  image = start_image(std::move(image));
+  if (record_cost)
+    image.enable_costs();
+  CONST_VAR std::vector<tile> tiles = make_tiles();
+  std::unique_ptr<checkpoint_writer> checkpoint;
+  if (!checkpoint_path.empty())
+    checkpoint.reset(
+        new checkpoint_writer(checkpoint_path, checkpoint_interval,
+                              checkpoint_fingerprint, image));
+  std::clog << "Rendering " << tiles.size() << " tiles in " << num_workers
+            << " worker processes\n";
+
+  // Writing to a worker that has died has to fail with EPIPE instead of
+  // ending this process.
+  struct sigaction ignore_pipe = {};
+  struct sigaction old_pipe;
+  ignore_pipe.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &ignore_pipe, &old_pipe);
+
+  std::vector<worker> workers(num_workers);
+  std::deque<int> queue; // Tiles no worker holds
+  for (int index = 0; index < int(tiles.size()); index++)
+    queue.push_back(index);
+
+  auto spawn = [&](worker &w) {
+    int to_worker[2];
+    int from_worker[2];
+    if (pipe(to_worker) != 0)
+      return false;
+    if (pipe(from_worker) != 0) {
+      close(to_worker[0]);
+      close(to_worker[1]);
+      return false;
+    }
+    // The child must not write out what is still buffered here a second
+    // time.
+    std::cout.flush();
+    std::clog.flush();
+    CONST_VAR pid_t pid = fork();
+    if (pid == 0) {
+      // The child keeps only its own pipe ends open, so that the coordinator
+      // sees the end of every other worker's pipes when that worker dies.
+      for (auto &other : workers)
+        close_pipes(other);
+      close(to_worker[1]);
+      close(from_worker[0]);
+      // Tiles still to be rendered hold the samples they started with.
+      serve_tiles(world, tiles, image, to_worker[0], from_worker[1]);
+      _exit(0);
+    }
+    close(to_worker[0]);
+    close(from_worker[1]);
+    if (pid < 0) {
+      close(to_worker[1]);
+      close(from_worker[0]);
+      return false;
+    }
+    w.pid = pid;
+    w.requests = to_worker[1];
+    w.results = from_worker[0];
+    return true;
+  };
+
+  // Hands the tiles of a dead worker out again and starts a new worker in
+  // its place while restarts remain.
+  int restarts = restarts_per_worker * num_workers;
+  auto replace = [&](worker &w) {
+    queue.insert(queue.begin(), w.pending.begin(), w.pending.end());
+    w.pending.clear();
+    close_pipes(w);
+    kill(w.pid, SIGKILL);
+    waitpid(w.pid, nullptr, 0);
+    std::clog << "\nWorker process " << w.pid << " died";
+    w.pid = -1;
+    if (restarts > 0 && spawn(w)) {
+      restarts--;
+      std::clog << ", restarted as " << w.pid << '\n';
+    } else {
+      std::clog << '\n';
+    }
+  };
+
+  // Tops up the tiles w holds.
+  auto supply = [&](worker &w) {
+    while (w.pid > 0) {
+      bool sent = true;
+      while (sent && w.pending.size() < tiles_in_flight && !queue.empty()) {
+        CONST_VAR std::int32_t index = queue.front();
+        sent = write_all(w.requests, &index, sizeof(index));
+        if (sent) {
+          queue.pop_front();
+          w.pending.push_back(index);
+        }
+      }
+      if (sent)
+        return;
+      replace(w);
+    }
+  };
+
+  std::vector<render_stats> worker_stats(num_workers + 1);
+  int tiles_remaining = int(tiles.size());
+  auto finish_tile = [&] {
+    tiles_remaining--;
+    std::clog << "\rTiles remaining: " << tiles_remaining << ' '
+              << std::flush;
+  };
+
+  CONST_VAR auto start = std::chrono::steady_clock::now();
+  for (auto &w : workers) {
+    if (!spawn(w))
+      std::clog << "Cannot start a worker process\n";
+    supply(w);
+  }
+
+  std::vector<pollfd> fds;
+  std::vector<int> slots;
+  std::vector<pixel_reply> pixels;
+  while (tiles_remaining > 0) {
+    fds.clear();
+    slots.clear();
+    for (int k = 0; k < num_workers; k++) {
+      if (workers[k].pid > 0) {
+        fds.push_back({workers[k].results, POLLIN, 0});
+        slots.push_back(k);
+      }
+    }
+    if (fds.empty())
+      break;
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    for (std::size_t f = 0; f < fds.size(); f++) {
+      if (fds[f].revents == 0)
+        continue;
+      CONST_VAR int slot = slots[f];
+      worker &w = workers[slot];
+
+      // A tile only counts once all of its pixels have arrived, so a worker
+      // that dies halfway through a reply leaves no trace in the image.
+      tile_reply reply;
+      bool received = read_all(w.results, &reply, sizeof(reply)) &&
+                      !w.pending.empty() && reply.tile == w.pending.front();
+      if (received) {
+        CONST_VAR tile &t = tiles[reply.tile];
+        pixels.resize(std::size_t(t.x1 - t.x0) * (t.y1 - t.y0));
+        received = read_all(w.results, pixels.data(),
+                            pixels.size() * sizeof(pixel_reply));
+      }
+      if (!received) {
+        replace(w);
+        supply(w);
+        continue;
+      }
+
+      // Workers start from the same samples, so their totals replace them.
+      CONST_VAR tile &t = tiles[reply.tile];
+      CONST_VAR std::uint64_t samples_before = tile_samples(t, image);
+      std::size_t p = 0;
+      for (int j = t.y0; j < t.y1; j++) {
+        for (int i = t.x0; i < t.x1; i++, p++) {
+          const pixel_reply &pixel = pixels[p];
+          image.set_samples(i, j,
+                            colour(pixel.sum[0], pixel.sum[1], pixel.sum[2]),
+                            int(pixel.samples));
+          if (record_cost)
+            image.add_cost(i, j, pixel.cost);
+        }
+      }
+      if (checkpoint)
+        checkpoint->add_finished(image, t.x0, t.y0, t.x1, t.y1);
+      render_stats tile_stats;
+      tile_stats.add_counters(reply.counters);
+      tile_stats.tiles.push_back({t.x0, t.y0, t.x1, t.y1, slot,
+                                  reply.seconds,
+                                  tile_samples(t, image) - samples_before,
+                                  tile_stats.rays()});
+      worker_stats[slot] += tile_stats;
+      w.pending.pop_front();
+      finish_tile();
+      supply(w);
+    }
+  }
+
+  // Closing the request pipes tells the workers to exit.
+  for (auto &w : workers) {
+    if (w.pid > 0) {
+      close_pipes(w);
+      waitpid(w.pid, nullptr, 0);
+    }
+  }
+  sigaction(SIGPIPE, &old_pipe, nullptr);
+
+  if (tiles_remaining > 0) {
+    std::clog << "\nNo worker processes left, rendering the last "
+              << tiles_remaining << " tiles here\n";
+    render_stats &local = render_stats::local();
+    for (CONST_VAR int index : queue) {
+      CONST_VAR tile &t = tiles[index];
+      local = render_stats();
+      CONST_VAR std::uint64_t samples_before = tile_samples(t, image);
+      CONST_VAR auto tile_start = std::chrono::steady_clock::now();
+      render_tile(world, t, image);
+      if (checkpoint)
+        checkpoint->add_finished(image, t.x0, t.y0, t.x1, t.y1);
+      local.tiles.push_back({t.x0, t.y0, t.x1, t.y1, num_workers,
+                             seconds_since(tile_start),
+                             tile_samples(t, image) - samples_before,
+                             local.rays()});
+      worker_stats[num_workers] += local;
+      finish_tile();
+    }
+    local = render_stats();
+  }
+
+  std::clog << "\rDone.                 \n";
+  if (checkpoint)
+    checkpoint->write();
+  if (record_features) {
+    // The workers have exited, so threads here take their place.
+    thread_pool pool(num_workers);
+    render_features(world, image, pool);
+  }
+  finish_render(image, worker_stats, num_workers, seconds_since(start));
+  if (preview)
+    preview(image);
+  return image;
+}
+
+void camera::serve_tiles(const hittable &world, const std::vector<tile> &tiles,
+                         framebuffer image, const int requests,
+                         const int results) const {
+  if (record_cost)
+    image.enable_costs();
+  render_stats &local = render_stats::local();
+  std::vector<pixel_reply> pixels;
+
+  std::int32_t index;
+  while (read_all(requests, &index, sizeof(index))) {
+    if (index < 0 || index >= std::int32_t(tiles.size()))
+      break;
+    const tile &t = tiles[index];
+    local = render_stats();
+    CONST_VAR auto tile_start = std::chrono::steady_clock::now();
+    render_tile(world, t, image);
+
+    tile_reply reply = {index, 0, seconds_since(tile_start), {}};
+    local.copy_counters(reply.counters);
+    pixels.clear();
+    for (int j = t.y0; j < t.y1; j++) {
+      for (int i = t.x0; i < t.x1; i++) {
+        CONST_VAR colour sum = image.sum(i, j);
+        pixels.push_back({{sum.x(), sum.y(), sum.z()},
+                          image.cost(i, j),
+                          image.samples(i, j)});
+      }
+    }
+    if (!write_all(results, &reply, sizeof(reply)) ||
+        !write_all(results, pixels.data(),
+                   pixels.size() * sizeof(pixel_reply)))
+      break;
+  }
+}
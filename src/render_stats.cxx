@@ -0,0 +1,183 @@
+#include "render_stats.hpp"
+
+#include <algorithm>
+
+namespace {
+
+const char *const primitive_names[render_stats::num_primitive_kinds] = {
+    "sphere", "sphere_set"};
+const char *const material_names[render_stats::num_material_kinds] = {
+    "lambertian", "metal", "dielectric", "diffuse_light"};
+
+// Writes values[0, count) as a JSON array, leaving off trailing zeros.
+void write_array(std::ostream &out, const std::uint64_t *values, int count) {
+  while (count > 0 && values[count - 1] == 0)
+    count--;
+  out << '[';
+  for (int i = 0; i < count; i++)
+    out << (i > 0 ? ", " : "") << values[i];
+  out << ']';
+}
+
+// Writes {"name": values[i], ...} for every kind.
+void write_by_kind(std::ostream &out, const char *const *names,
+                   const std::uint64_t *values, const int count) {
+  out << '{';
+  for (int i = 0; i < count; i++)
+    out << (i > 0 ? ", " : "") << '"' << names[i] << "\": " << values[i];
+  out << '}';
+}
+
+} // namespace
+
+render_stats &render_stats::operator+=(const render_stats &other) {
+  for (int d = 0; d < depth_buckets; d++)
+    rays_by_depth[d] += other.rays_by_depth[d];
+  shadow_rays += other.shadow_rays;
+  shadow_rays_occluded += other.shadow_rays_occluded;
+  for (int k = 0; k < num_primitive_kinds; k++) {
+    tests[k] += other.tests[k];
+    hits[k] += other.hits[k];
+  }
+  finalizations += other.finalizations;
+  for (int k = 0; k < num_material_kinds; k++) {
+    scatters[k] += other.scatters[k];
+    absorptions[k] += other.absorptions[k];
+  }
+  paths_escaped += other.paths_escaped;
+  paths_absorbed += other.paths_absorbed;
+  paths_max_depth += other.paths_max_depth;
+  paths_roulette += other.paths_roulette;
+  tiles.insert(tiles.end(), other.tiles.begin(), other.tiles.end());
+  return *this;
+}
+
+void render_stats::copy_counters(std::uint64_t *out) const {
+  out = std::copy(rays_by_depth, rays_by_depth + depth_buckets, out);
+  *out++ = shadow_rays;
+  *out++ = shadow_rays_occluded;
+  out = std::copy(tests, tests + num_primitive_kinds, out);
+  out = std::copy(hits, hits + num_primitive_kinds, out);
+  *out++ = finalizations;
+  out = std::copy(scatters, scatters + num_material_kinds, out);
+  out = std::copy(absorptions, absorptions + num_material_kinds, out);
+  *out++ = paths_escaped;
+  *out++ = paths_absorbed;
+  *out++ = paths_max_depth;
+  *out++ = paths_roulette;
+}
+
+void render_stats::add_counters(const std::uint64_t *in) {
+  for (int d = 0; d < depth_buckets; d++)
+    rays_by_depth[d] += *in++;
+  shadow_rays += *in++;
+  shadow_rays_occluded += *in++;
+  for (int k = 0; k < num_primitive_kinds; k++)
+    tests[k] += *in++;
+  for (int k = 0; k < num_primitive_kinds; k++)
+    hits[k] += *in++;
+  finalizations += *in++;
+  for (int k = 0; k < num_material_kinds; k++)
+    scatters[k] += *in++;
+  for (int k = 0; k < num_material_kinds; k++)
+    absorptions[k] += *in++;
+  paths_escaped += *in++;
+  paths_absorbed += *in++;
+  paths_max_depth += *in++;
+  paths_roulette += *in++;
+}
+
+std::uint64_t render_stats::rays() const {
+  std::uint64_t total = shadow_rays;
+  for (CONST_VAR auto count : rays_by_depth)
+    total += count;
+  return total;
+}
+
+void render_stats::print(std::ostream &out) const {
+  std::uint64_t all_hits = 0;
+  for (CONST_VAR auto count : hits)
+    all_hits += count;
+
+  out << "Rays: " << rays() << " (shadow rays: " << shadow_rays
+      << ", occluded: " << shadow_rays_occluded << ")\n";
+  // Before intersect() and finalize() were separate, every closer hit filled
+  // in a hit record.
+  out << "Closer hits: " << all_hits << '\n';
+  out << "Hit records filled: " << finalizations << " (saved "
+      << (all_hits - finalizations) << ")\n";
+  out << "Paths escaped: " << paths_escaped << ", absorbed: " << paths_absorbed
+      << ", at max depth: " << paths_max_depth
+      << ", ended by roulette: " << paths_roulette << '\n';
+}
+
+void render_stats::write_json(std::ostream &out) const {
+  out << "{\n";
+#if ENABLE_STATS
+  out << "  \"enabled\": true,\n";
+#else
+  out << "  \"enabled\": false,\n";
+#endif
+  out << "  \"threads\": " << threads << ",\n";
+  out << "  \"seconds\": " << seconds << ",\n";
+  out << "  \"rays\": " << rays() << ",\n";
+  out << "  \"rays_by_depth\": ";
+  write_array(out, rays_by_depth, depth_buckets);
+  out << ",\n  \"shadow_rays\": " << shadow_rays;
+  out << ",\n  \"shadow_rays_occluded\": " << shadow_rays_occluded;
+  out << ",\n  \"intersection_tests\": ";
+  write_by_kind(out, primitive_names, tests, num_primitive_kinds);
+  out << ",\n  \"intersection_hits\": ";
+  write_by_kind(out, primitive_names, hits, num_primitive_kinds);
+  out << ",\n  \"finalizations\": " << finalizations;
+  out << ",\n  \"scatters\": ";
+  write_by_kind(out, material_names, scatters, num_material_kinds);
+  out << ",\n  \"absorptions\": ";
+  write_by_kind(out, material_names, absorptions, num_material_kinds);
+  out << ",\n  \"paths\": {\"escaped\": " << paths_escaped
+      << ", \"absorbed\": " << paths_absorbed
+      << ", \"max_depth\": " << paths_max_depth
+      << ", \"roulette\": " << paths_roulette << "}";
+
+  CONST_VAR std::vector<tile_time> sorted = tiles_in_image_order();
+  out << ",\n  \"tiles\": [";
+  for (std::size_t i = 0; i < sorted.size(); i++) {
+    CONST_VAR tile_time &t = sorted[i];
+    out << (i > 0 ? "," : "") << "\n    {\"x0\": " << t.x0
+        << ", \"y0\": " << t.y0 << ", \"x1\": " << t.x1
+        << ", \"y1\": " << t.y1 << ", \"thread\": " << t.thread
+        << ", \"seconds\": " << t.seconds << ", \"samples\": " << t.samples
+        << ", \"rays\": " << t.rays << '}';
+  }
+  out << (sorted.empty() ? "]" : "\n  ]") << "\n}\n";
+}
+
+void render_stats::write_tile_csv(std::ostream &out) const {
+  out << "x0,y0,x1,y1,thread,seconds,samples,rays,ns_per_sample\n";
+  for (CONST_VAR auto &t : tiles_in_image_order()) {
+    CONST_VAR double ns_per_sample =
+        t.samples > 0 ? 1e9 * t.seconds / t.samples : 0;
+    out << t.x0 << ',' << t.y0 << ',' << t.x1 << ',' << t.y1 << ','
+        << t.thread << ',' << t.seconds << ',' << t.samples << ',' << t.rays
+        << ',' << ns_per_sample << '\n';
+  }
+}
+
+// Sorted so that reports of two renders line up.
+std::vector<tile_time> render_stats::tiles_in_image_order() const {
+  std::vector<tile_time> sorted = tiles;
+  std::sort(sorted.begin(), sorted.end(),
+            [](const tile_time &a, const tile_time &b) {
+              return a.y0 != b.y0 ? a.y0 < b.y0 : a.x0 < b.x0;
+            });
+  return sorted;
+}
+
+int render_stats::depth_bucket(const int depth) {
+  return std::min(depth, depth_buckets - 1);
+}
+
+render_stats &render_stats::local() {
+  static thread_local render_stats stats;
+  return stats;
+}
@@ -0,0 +1,242 @@
+#include "sampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Bases of the Halton dimensions; deeper dimensions fall back to random
+// numbers, as Halton points in large bases are poorly spread.
+constexpr int halton_dimensions = 32;
+const unsigned halton_bases[halton_dimensions] = {
+    2,  3,  5,  7,  11, 13, 17, 19, 23, 29, 31, 37, 41, 43,  47,  53,
+    59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131};
+
+std::uint64_t hash(const std::uint64_t seed, const std::uint64_t value) {
+  return rng(seed ^ (value * 0x9e3779b97f4a7c15ULL)).next_u64();
+}
+
+// [0, 1) from the top 53 bits of a hash.
+double to_unit(const std::uint64_t bits) {
+  return double(bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// [0, 1) from a 32-bit fixed point fraction.
+double fraction_to_unit(const std::uint32_t bits) {
+  return bits * (1.0 / 4294967296.0);
+}
+
+std::uint32_t reverse_bits(std::uint32_t x) {
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+// Owen scrambling of the bits of x, most significant first, with a hash in
+// place of the tree of random flips (Burley, "Practical Hash-based Owen
+// Scrambling", 2020).
+std::uint32_t owen_scramble(std::uint32_t x, const std::uint32_t seed) {
+  x = reverse_bits(x);
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return reverse_bits(x);
+}
+
+// The first two dimensions of the Sobol sequence, as 32-bit fractions.
+std::uint32_t sobol_0(const std::uint32_t index) { return reverse_bits(index); }
+
+// The second dimension is linear in the bits of the index, so it is the XOR
+// of the contributions of the index's four bytes, which are tabulated.
+class sobol_1_table {
+public:
+  std::uint32_t bytes[4][256];
+
+  sobol_1_table() {
+    std::uint32_t columns[32];
+    std::uint32_t v = 1u << 31;
+    for (int bit = 0; bit < 32; bit++, v ^= v >> 1)
+      columns[bit] = v;
+    for (int byte = 0; byte < 4; byte++) {
+      for (int value = 0; value < 256; value++) {
+        std::uint32_t result = 0;
+        for (int bit = 0; bit < 8; bit++)
+          if (value & (1 << bit))
+            result ^= columns[8 * byte + bit];
+        bytes[byte][value] = result;
+      }
+    }
+  }
+};
+
+const sobol_1_table sobol_1_bytes;
+
+std::uint32_t sobol_1(const std::uint32_t index) {
+  return sobol_1_bytes.bytes[0][index & 0xff] ^
+         sobol_1_bytes.bytes[1][(index >> 8) & 0xff] ^
+         sobol_1_bytes.bytes[2][(index >> 16) & 0xff] ^
+         sobol_1_bytes.bytes[3][index >> 24];
+}
+
+// A pseudo-random permutation of [0, n) chosen by seed (Kensler,
+// "Correlated Multi-Jittered Sampling", 2013).
+std::uint32_t permute(std::uint32_t i, const std::uint32_t n,
+                      const std::uint32_t seed) {
+  std::uint32_t w = n - 1;
+  w |= w >> 1;
+  w |= w >> 2;
+  w |= w >> 4;
+  w |= w >> 8;
+  w |= w >> 16;
+  do {
+    i ^= seed;
+    i *= 0xe170893du;
+    i ^= seed >> 16;
+    i ^= (i & w) >> 4;
+    i ^= seed >> 8;
+    i *= 0x0929eb3fu;
+    i ^= seed >> 23;
+    i ^= (i & w) >> 1;
+    i *= 1 | seed >> 27;
+    i *= 0x6935fa69u;
+    i ^= (i & w) >> 11;
+    i *= 0x74dcb303u;
+    i ^= (i & w) >> 2;
+    i *= 0x9e501cc3u;
+    i ^= (i & w) >> 2;
+    i *= 0xc860a3dfu;
+    i &= w;
+    i ^= i >> 5;
+  } while (i >= n);
+  return (i + seed) % n;
+}
+
+// The radical inverse of index in base, with each digit position's digits
+// shuffled by its own permutation chosen by seed. Unscrambled, the dimensions
+// in large bases count up in step for the first samples (sample i is near
+// i / base in every one of them), so pairs of them fall on lines. Only the
+// first `digits` positions, those in which the samples of a pixel differ,
+// are shuffled; the rest are a uniform offset drawn from jitter, which is
+// what shuffling them would amount to.
+double scrambled_radical_inverse(const unsigned base, std::uint32_t index,
+                                 const int digits, const std::uint64_t seed,
+                                 const double jitter) {
+  CONST_VAR double inverse_base = 1.0 / base;
+  double digit_value = inverse_base;
+  double result = 0;
+  for (int position = 0; position < digits; position++) {
+    CONST_VAR std::uint32_t digit = permute(
+        index % base, base, std::uint32_t(hash(seed, unsigned(position))));
+    result += digit * digit_value;
+    index /= base;
+    digit_value *= inverse_base;
+  }
+  return result + jitter * digit_value * base;
+}
+
+} // namespace
+
+bool parse_sample_pattern(const std::string &name, sample_pattern &pattern) {
+  if (name == "random")
+    pattern = sample_pattern::random;
+  else if (name == "stratified")
+    pattern = sample_pattern::stratified;
+  else if (name == "halton")
+    pattern = sample_pattern::halton;
+  else if (name == "sobol")
+    pattern = sample_pattern::sobol;
+  else
+    return false;
+  return true;
+}
+
+sampler::sampler(const sample_pattern pattern, const std::uint64_t pixel,
+                 const std::uint32_t sample,
+                 const std::uint32_t samples_per_pixel)
+    : pattern(pattern), sample(sample),
+      samples_per_pixel(samples_per_pixel < 1 ? 1 : samples_per_pixel),
+      seed(hash(pixel, 0x5eed)) {}
+
+sampler::sampler() : sampler(sample_pattern::random, 0, 0, 1) {}
+
+double sampler::next_1d() { return get_1d(dimension++); }
+
+sample_2d sampler::next_2d() {
+  CONST_VAR sample_2d result = get_2d(dimension);
+  dimension += 2;
+  return result;
+}
+
+void sampler::start_bounce(const int bounce) {
+  bounce_start = camera_dimensions + (bounce - 1) * bounce_dimensions;
+  dimension = bounce_start;
+}
+
+double sampler::roulette_1d() const { return get_1d(bounce_start + 3); }
+
+sample_2d sampler::light_2d() const { return get_2d(bounce_start + 4); }
+
+double sampler::light_1d() const { return get_1d(bounce_start + 6); }
+
+double sampler::get_1d(const int d) const {
+  CONST_VAR std::uint64_t point = (std::uint64_t(sample) << 32) | unsigned(d);
+  switch (pattern) {
+  case sample_pattern::random:
+    break;
+  case sample_pattern::stratified: {
+    CONST_VAR std::uint32_t n = samples_per_pixel;
+    CONST_VAR std::uint32_t stratum =
+        permute(sample % n, n, std::uint32_t(hash(seed, d)));
+    return (stratum + to_unit(hash(~seed, point))) / n;
+  }
+  case sample_pattern::halton:
+    if (d < halton_dimensions) {
+      CONST_VAR unsigned base = halton_bases[d];
+      int digits = 0;
+      for (std::uint32_t n = std::max(sample, samples_per_pixel - 1); n != 0;
+           n /= base)
+        digits++;
+      return scrambled_radical_inverse(base, sample, digits, hash(seed, d),
+                                       to_unit(hash(~seed, point)));
+    }
+    break;
+  case sample_pattern::sobol: {
+    CONST_VAR sample_2d pair = sobol_pair(d / 2);
+    return d % 2 == 0 ? pair.u : pair.v;
+  }
+  }
+  return to_unit(hash(seed, point));
+}
+
+sample_2d sampler::get_2d(const int d) const {
+  if (pattern == sample_pattern::stratified) {
+    // One stratum of an m by m grid, where m * m >= samples_per_pixel.
+    std::uint32_t m = std::uint32_t(std::sqrt(double(samples_per_pixel)));
+    while (m * m < samples_per_pixel)
+      m++;
+    CONST_VAR std::uint32_t cells = m * m;
+    CONST_VAR std::uint32_t cell =
+        permute(sample % cells, cells, std::uint32_t(hash(seed, d)));
+    CONST_VAR std::uint64_t point = (std::uint64_t(sample) << 32) | unsigned(d);
+    return {(cell % m + to_unit(hash(~seed, point))) / m,
+            (cell / m + to_unit(hash(~seed, point + 1))) / m};
+  }
+  if (pattern == sample_pattern::sobol && d % 2 == 0)
+    return sobol_pair(d / 2);
+  return {get_1d(d), get_1d(d + 1)};
+}
+
+sample_2d sampler::sobol_pair(const int pair) const {
+  // Each pair of dimensions is its own scrambled 2D Sobol sequence, with the
+  // sample order shuffled so that pairs are not correlated.
+  CONST_VAR std::uint64_t pair_seed = hash(seed, pair);
+  CONST_VAR std::uint32_t index =
+      owen_scramble(sample, std::uint32_t(pair_seed));
+  CONST_VAR std::uint32_t scramble = std::uint32_t(pair_seed >> 32);
+  return {fraction_to_unit(owen_scramble(sobol_0(index), scramble)),
+          fraction_to_unit(owen_scramble(sobol_1(index), scramble + 1))};
+}
@@ -0,0 +1,533 @@
+#include "scene_file.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// A public setting of camera, stored in scene files under its name as one
+// number, or three for vectors. Exactly one of the member pointers is set.
+class camera_field {
+public:
+  const char *name;
+  double camera::*double_value;
+  int camera::*int_value;
+  bool camera::*bool_value;
+  vec3 camera::*vec3_value;
+  bool positive = false; // The camera needs the value to be above zero
+
+  int size() const { return vec3_value ? 3 : 1; }
+
+  // Whether set() can take values: they have to be finite, whole number
+  // settings within the range of int, and positive ones at least 1 or,
+  // for doubles, above zero.
+  bool valid(const double *values) const {
+    for (int i = 0; i < size(); i++)
+      if (!std::isfinite(values[i]))
+        return false;
+    if (int_value && (values[0] < std::numeric_limits<int>::min() ||
+                      values[0] > std::numeric_limits<int>::max()))
+      return false;
+    if (positive)
+      return int_value ? values[0] >= 1 : values[0] > 0;
+    return true;
+  }
+
+  void get(const camera &cam, double *values) const {
+    if (double_value)
+      values[0] = cam.*double_value;
+    else if (int_value)
+      values[0] = cam.*int_value;
+    else if (bool_value)
+      values[0] = cam.*bool_value;
+    else
+      for (int i = 0; i < 3; i++)
+        values[i] = (cam.*vec3_value)[i];
+  }
+
+  void set(camera &cam, const double *values) const {
+    if (double_value)
+      cam.*double_value = values[0];
+    else if (int_value)
+      cam.*int_value = int(values[0]);
+    else if (bool_value)
+      cam.*bool_value = values[0] != 0;
+    else
+      cam.*vec3_value = vec3(values[0], values[1], values[2]);
+  }
+};
+
+const camera_field camera_fields[] = {
+    {"aspect_ratio", &camera::aspect_ratio, nullptr, nullptr, nullptr, true},
+    {"image_width", nullptr, &camera::image_width, nullptr, nullptr, true},
+    {"samples_per_pixel", nullptr, &camera::samples_per_pixel, nullptr,
+     nullptr, true},
+    {"max_depth", nullptr, &camera::max_depth, nullptr, nullptr},
+    {"roulette_depth", nullptr, &camera::roulette_depth, nullptr, nullptr},
+    {"vfov", &camera::vfov, nullptr, nullptr, nullptr},
+    {"lookfrom", nullptr, nullptr, nullptr, &camera::lookfrom},
+    {"lookat", nullptr, nullptr, nullptr, &camera::lookat},
+    {"vup", nullptr, nullptr, nullptr, &camera::vup},
+    {"defocus_angle", &camera::defocus_angle, nullptr, nullptr, nullptr},
+    {"focus_dist", &camera::focus_dist, nullptr, nullptr, nullptr},
+    {"num_threads", nullptr, &camera::num_threads, nullptr, nullptr},
+    {"tile_size", nullptr, &camera::tile_size, nullptr, nullptr, true},
+    {"packet_mode", nullptr, nullptr, &camera::packet_mode, nullptr},
+    {"wavefront", nullptr, nullptr, &camera::wavefront, nullptr},
+    {"record_cost", nullptr, nullptr, &camera::record_cost, nullptr},
+    {"adaptive_threshold", &camera::adaptive_threshold, nullptr, nullptr,
+     nullptr},
+    {"min_samples", nullptr, &camera::min_samples, nullptr, nullptr},
+    {"sky_brightness", &camera::sky_brightness, nullptr, nullptr, nullptr},
+    {"light_sampling", nullptr, nullptr, &camera::light_sampling, nullptr},
+};
+
+// Numbers the camera settings take up in a binary file.
+std::size_t camera_values() {
+  std::size_t count = 0;
+  for (CONST_VAR auto &field : camera_fields)
+    count += field.size();
+  return count;
+}
+
+const char *material_kind_name(const material_kind kind) {
+  switch (kind) {
+  case material_kind::lambertian:
+    return "lambertian";
+  case material_kind::metal:
+    return "metal";
+  case material_kind::dielectric:
+    return "dielectric";
+  case material_kind::diffuse_light:
+    return "diffuse_light";
+  }
+  return "";
+}
+
+// Number of values each material kind takes in the text form.
+int material_kind_values(const material_kind kind) {
+  switch (kind) {
+  case material_kind::lambertian:
+    return 3;
+  case material_kind::metal:
+    return 4;
+  case material_kind::dielectric:
+    return 1;
+  case material_kind::diffuse_light:
+    return 3;
+  }
+  return 0;
+}
+
+// Parses a number or, for boolean settings, "true" or "false".
+bool parse_number(const std::string &token, double &value) {
+  if (token == "true" || token == "false") {
+    value = token == "true";
+    return true;
+  }
+  char *end = nullptr;
+  value = std::strtod(token.c_str(), &end);
+  return !token.empty() && *end == '\0';
+}
+
+bool load_scene_text(const std::string &path, camera &cam, scene &result) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Cannot open " << path << '\n';
+    return false;
+  }
+
+  std::unordered_map<std::string, material_id> material_ids;
+  std::string line;
+  int line_number = 0;
+  auto fail = [&](const std::string &message) {
+    std::cerr << path << ':' << line_number << ": " << message << '\n';
+    return false;
+  };
+
+  while (std::getline(in, line)) {
+    line_number++;
+    CONST_VAR std::size_t comment = line.find('#');
+    if (comment != std::string::npos)
+      line.resize(comment);
+    std::istringstream tokens(line);
+    std::string directive;
+    if (!(tokens >> directive))
+      continue;
+
+    std::vector<std::string> args;
+    for (std::string arg; tokens >> arg;)
+      args.push_back(arg);
+    std::vector<double> numbers(args.size());
+    auto parse_numbers = [&](const std::size_t first, const std::size_t last) {
+      for (std::size_t i = first; i < last; i++)
+        if (!parse_number(args[i], numbers[i]))
+          return false;
+      return true;
+    };
+
+    if (directive == "camera") {
+      const camera_field *field = nullptr;
+      for (CONST_VAR auto &candidate : camera_fields)
+        if (!args.empty() && args[0] == candidate.name)
+          field = &candidate;
+      if (!field)
+        return fail("unknown camera setting");
+      if (int(args.size()) != 1 + field->size() ||
+          !parse_numbers(1, args.size()))
+        return fail(std::string("expected ") + std::to_string(field->size()) +
+                    " number(s) for " + field->name);
+      if (!field->valid(&numbers[1]))
+        return fail(std::string("invalid value for ") + field->name);
+      field->set(cam, &numbers[1]);
+    } else if (directive == "material") {
+      if (args.size() < 2)
+        return fail("expected a material name and kind");
+      material_params params = {material_kind::lambertian, {0, 0, 0, 0}};
+      if (args[1] == "lambertian")
+        params.kind = material_kind::lambertian;
+      else if (args[1] == "metal")
+        params.kind = material_kind::metal;
+      else if (args[1] == "dielectric")
+        params.kind = material_kind::dielectric;
+      else if (args[1] == "diffuse_light")
+        params.kind = material_kind::diffuse_light;
+      else
+        return fail("unknown material kind " + args[1]);
+      CONST_VAR int count = material_kind_values(params.kind);
+      if (int(args.size()) != 2 + count || !parse_numbers(2, args.size()))
+        return fail("expected " + std::to_string(count) + " number(s) for " +
+                    args[1]);
+      for (int i = 0; i < count; i++)
+        params.values[i] = numbers[2 + i];
+      material_ids[args[0]] = result.materials.add(material(params));
+    } else if (directive == "sphere") {
+      if (args.size() != 5 || !parse_numbers(0, 4))
+        return fail("expected x, y, z, radius and a material name");
+      CONST_VAR auto mat = material_ids.find(args[4]);
+      if (mat == material_ids.end())
+        return fail("unknown material " + args[4]);
+      result.spheres->add(point3(numbers[0], numbers[1], numbers[2]),
+                          numbers[3], mat->second);
+    } else {
+      return fail("unknown directive " + directive);
+    }
+  }
+  return true;
+}
+
+// Start of a binary scene file.
+class binary_header {
+public:
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t real_size; // sizeof(real) of the program that wrote it
+  std::uint64_t camera_values;
+  std::uint64_t num_materials;
+  std::uint64_t num_spheres;
+};
+
+constexpr char binary_magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+constexpr std::uint32_t binary_version = 2;
+
+class binary_material {
+public:
+  std::uint32_t kind;
+  std::uint32_t padding;
+  double values[4];
+};
+
+// Byte offsets of the parts of a binary scene file.
+class binary_layout {
+public:
+  static constexpr std::size_t alignment = 64;
+  static constexpr int num_arrays = 5; // x, y, z, radius, material
+
+  std::size_t camera;
+  std::size_t materials;
+  std::size_t arrays[num_arrays];
+  std::size_t end;
+
+  explicit binary_layout(const binary_header &header) {
+    camera = align(sizeof(binary_header));
+    materials = align(camera + header.camera_values * sizeof(double));
+    std::size_t offset =
+        align(materials + header.num_materials * sizeof(binary_material));
+    for (int i = 0; i < num_arrays; i++) {
+      CONST_VAR std::size_t element =
+          i < num_arrays - 1 ? header.real_size : sizeof(material_id);
+      arrays[i] = offset;
+      offset = align(offset + header.num_spheres * element);
+    }
+    end = offset;
+  }
+
+  static std::size_t align(const std::size_t offset) {
+    return (offset + alignment - 1) / alignment * alignment;
+  }
+};
+
+// A read-only mapping of a whole file, unmapped when destroyed.
+class mapped_file {
+public:
+  const char *data = nullptr;
+  std::size_t size = 0;
+
+  ~mapped_file() {
+    if (data)
+      ::munmap(const_cast<char *>(data), size);
+  }
+};
+
+// Copies spheres stored with a precision other than real.
+template <class stored>
+void add_converted(sphere_set &spheres, const char *data,
+                   const binary_layout &layout, const std::size_t count) {
+  const stored *x = reinterpret_cast<const stored *>(data + layout.arrays[0]);
+  const stored *y = reinterpret_cast<const stored *>(data + layout.arrays[1]);
+  const stored *z = reinterpret_cast<const stored *>(data + layout.arrays[2]);
+  const stored *r = reinterpret_cast<const stored *>(data + layout.arrays[3]);
+  const material_id *m =
+      reinterpret_cast<const material_id *>(data + layout.arrays[4]);
+  for (std::size_t i = 0; i < count; i++)
+    spheres.add(point3(x[i], y[i], z[i]), r[i], m[i]);
+}
+
+// Whether sphere i has a finite, non-negative radius. Spheres read in place
+// skip the clamping sphere_set::add does, so bad radii are refused instead.
+bool valid_radius(const char *data, const binary_layout &layout,
+                  const std::uint32_t real_size, const std::size_t i) {
+  double r;
+  if (real_size == sizeof(float)) {
+    float stored;
+    std::memcpy(&stored, data + layout.arrays[3] + i * sizeof(stored),
+                sizeof(stored));
+    r = stored;
+  } else {
+    std::memcpy(&r, data + layout.arrays[3] + i * sizeof(r), sizeof(r));
+  }
+  return std::isfinite(r) && r >= 0;
+}
+
+bool load_scene_binary(const std::string &path, camera &cam, scene &result) {
+  CONST_VAR int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Cannot open " << path << ": " << std::strerror(errno)
+              << '\n';
+    return false;
+  }
+  struct stat info;
+  if (::fstat(fd, &info) != 0 || info.st_size < 0) {
+    std::cerr << "Cannot read " << path << ": " << std::strerror(errno)
+              << '\n';
+    ::close(fd);
+    return false;
+  }
+
+  auto file = std::make_shared<mapped_file>();
+  file->size = std::size_t(info.st_size);
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  // Fault the whole file in at once; every page is read below anyway.
+  flags |= MAP_POPULATE;
+#endif
+  void *mapping = ::mmap(nullptr, file->size, PROT_READ, flags, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "Cannot map " << path << ": " << std::strerror(errno)
+              << '\n';
+    return false;
+  }
+  file->data = static_cast<const char *>(mapping);
+
+  auto fail = [&](const char *message) {
+    std::cerr << path << ": " << message << '\n';
+    return false;
+  };
+  binary_header header;
+  if (file->size < sizeof(header))
+    return fail("truncated header");
+  std::memcpy(&header, file->data, sizeof(header));
+  if (header.version != binary_version)
+    return fail("unsupported version");
+  if (header.real_size != sizeof(float) && header.real_size != sizeof(double))
+    return fail("unsupported precision");
+  if (header.camera_values != camera_values())
+    return fail("camera settings do not match this program");
+  if (header.num_spheres > std::numeric_limits<std::uint32_t>::max() ||
+      header.num_materials > std::numeric_limits<material_id>::max())
+    return fail("too many spheres or materials");
+  CONST_VAR binary_layout layout(header);
+  if (file->size < layout.end)
+    return fail("truncated file");
+
+  std::vector<double> values(header.camera_values);
+  std::memcpy(values.data(), file->data + layout.camera,
+              values.size() * sizeof(double));
+  std::size_t next = 0;
+  for (CONST_VAR auto &field : camera_fields) {
+    if (!field.valid(&values[next]))
+      return fail(
+          (std::string("invalid value for camera ") + field.name).c_str());
+    field.set(cam, &values[next]);
+    next += field.size();
+  }
+
+  for (std::size_t i = 0; i < header.num_materials; i++) {
+    binary_material stored;
+    std::memcpy(&stored, file->data + layout.materials + i * sizeof(stored),
+                sizeof(stored));
+    if (stored.kind > std::uint32_t(material_kind::diffuse_light))
+      return fail("unknown material kind");
+    material_params params = {material_kind(stored.kind), {}};
+    std::memcpy(params.values, stored.values, sizeof(params.values));
+    result.materials.add(material(params));
+  }
+
+  CONST_VAR std::size_t count = header.num_spheres;
+  const material_id *mats =
+      reinterpret_cast<const material_id *>(file->data + layout.arrays[4]);
+  for (std::size_t i = 0; i < count; i++) {
+    if (mats[i] >= header.num_materials)
+      return fail("sphere with an unknown material");
+    if (!valid_radius(file->data, layout, header.real_size, i))
+      return fail("sphere with a negative or non-finite radius");
+  }
+
+  if (header.real_size == sizeof(real)) {
+    auto array = [&](const int i) {
+      return reinterpret_cast<const real *>(file->data + layout.arrays[i]);
+    };
+    result.spheres = std::make_shared<sphere_set>(
+        count, array(0), array(1), array(2), array(3), mats, file);
+  } else if (header.real_size == sizeof(float)) {
+    add_converted<float>(*result.spheres, file->data, layout, count);
+  } else {
+    add_converted<double>(*result.spheres, file->data, layout, count);
+  }
+  return true;
+}
+
+// Writes zeros up to offset, which is less than one alignment ahead.
+void pad_to(std::ostream &out, const std::size_t offset) {
+  static const char zeros[binary_layout::alignment] = {};
+  CONST_VAR std::size_t position = std::size_t(out.tellp());
+  if (offset > position)
+    out.write(zeros, std::streamsize(offset - position));
+}
+
+} // namespace
+
+bool load_scene(const std::string &path, camera &cam, scene &result) {
+  char magic[sizeof(binary_magic)] = {};
+  {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      std::cerr << "Cannot open " << path << '\n';
+      return false;
+    }
+    in.read(magic, sizeof(magic));
+  }
+  if (std::memcmp(magic, binary_magic, sizeof(magic)) == 0)
+    return load_scene_binary(path, cam, result);
+  return load_scene_text(path, cam, result);
+}
+
+bool save_scene_text(const std::string &path, const camera &cam,
+                     const scene &s) {
+  std::ofstream out(path);
+  out << std::setprecision(std::numeric_limits<real>::max_digits10);
+  for (CONST_VAR auto &field : camera_fields) {
+    double values[3];
+    field.get(cam, values);
+    out << "camera " << field.name;
+    for (int i = 0; i < field.size(); i++)
+      out << ' ' << values[i];
+    out << '\n';
+  }
+
+  for (std::size_t i = 0; i < s.materials.size(); i++) {
+    CONST_VAR material_params params = s.materials[material_id(i)].params();
+    out << "material m" << i << ' ' << material_kind_name(params.kind);
+    for (int k = 0; k < material_kind_values(params.kind); k++)
+      out << ' ' << params.values[k];
+    out << '\n';
+  }
+
+  const sphere_set &spheres = *s.spheres;
+  for (std::size_t i = 0; i < spheres.size(); i++) {
+    CONST_VAR point3 center = spheres.center(i);
+    out << "sphere " << center.x() << ' ' << center.y() << ' ' << center.z()
+        << ' ' << spheres.radius(i) << " m" << spheres.mat(i) << '\n';
+  }
+
+  if (!out) {
+    std::cerr << "Cannot write " << path << '\n';
+    return false;
+  }
+  return true;
+}
+
+bool save_scene_binary(const std::string &path, const camera &cam,
+                       const scene &s) {
+  const sphere_set &spheres = *s.spheres;
+  binary_header header;
+  std::memcpy(header.magic, binary_magic, sizeof(header.magic));
+  header.version = binary_version;
+  header.real_size = sizeof(real);
+  header.camera_values = camera_values();
+  header.num_materials = s.materials.size();
+  header.num_spheres = spheres.size();
+  CONST_VAR binary_layout layout(header);
+
+  std::ofstream out(path, std::ios::binary);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  pad_to(out, layout.camera);
+  for (CONST_VAR auto &field : camera_fields) {
+    double values[3];
+    field.get(cam, values);
+    out.write(reinterpret_cast<const char *>(values),
+              field.size() * sizeof(double));
+  }
+
+  pad_to(out, layout.materials);
+  for (std::size_t i = 0; i < s.materials.size(); i++) {
+    CONST_VAR material_params params = s.materials[material_id(i)].params();
+    binary_material stored = {std::uint32_t(params.kind), 0, {}};
+    std::memcpy(stored.values, params.values, sizeof(stored.values));
+    out.write(reinterpret_cast<const char *>(&stored), sizeof(stored));
+  }
+
+  const void *arrays[binary_layout::num_arrays] = {
+      spheres.center_x_data(), spheres.center_y_data(),
+      spheres.center_z_data(), spheres.radius_data(), spheres.material_data()};
+  for (int i = 0; i < binary_layout::num_arrays; i++) {
+    CONST_VAR std::size_t element =
+        i < binary_layout::num_arrays - 1 ? sizeof(real) : sizeof(material_id);
+    pad_to(out, layout.arrays[i]);
+    out.write(static_cast<const char *>(arrays[i]),
+              std::streamsize(spheres.size() * element));
+  }
+  pad_to(out, layout.end);
+
+  if (!out) {
+    std::cerr << "Cannot write " << path << '\n';
+    return false;
+  }
+  return true;
+}
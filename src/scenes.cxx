@@ -0,0 +1,94 @@
+#include "scenes.hpp"
+#include "bvh.hpp"
+#include "sphere.hpp"
+#include "sphere_set.hpp"
+
+#include <memory>
+
+void scene::build_world(const std::string &accel) {
+  lights.clear();
+  for (std::size_t i = 0; i < spheres->size(); i++) {
+    const material &mat = materials[spheres->mat(i)];
+    if (mat.kind() == material_kind::diffuse_light)
+      lights.add(spheres->center(i), spheres->radius(i), spheres->mat(i),
+                 mat.emission());
+  }
+
+  world.clear();
+  objects.clear();
+  if (accel == "sphere_set") {
+    world.add(spheres);
+    return;
+  }
+
+  for (std::size_t i = 0; i < spheres->size(); i++)
+    world.add(objects.make<sphere>(spheres->center(i), spheres->radius(i),
+                                   spheres->mat(i)));
+  if (accel == "bvh") {
+    CONST_VAR bvh_node *tree = objects.make<bvh_node>(world);
+    world.clear();
+    world.add(tree);
+  }
+}
+
+scene random_spheres_scene(const std::string &accel, const std::uint64_t seed) {
+  scene result;
+  material_table &materials = result.materials;
+  sphere_set &spheres = *result.spheres;
+
+  rng gen(seed);
+  auto ground_material = materials.add(lambertian(colour(0.5, 0.5, 0.5)));
+  spheres.add(point3(0, -1000, 0), 1000, ground_material);
+
+  for (int a = -11; a < 11; a++) {
+    for (int b = -11; b < 11; b++) {
+      auto choose_mat = random_double(gen);
+      auto x = a + 0.9 * random_double(gen);
+      auto z = b + 0.9 * random_double(gen);
+      point3 center(x, 0.2, z);
+
+      if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+        material_id sphere_material;
+
+        if (choose_mat < 0.8) {
+          // diffuse
+          auto albedo = colour::random(gen) * colour::random(gen);
+          sphere_material = materials.add(lambertian(albedo));
+          spheres.add(center, 0.2, sphere_material);
+        } else if (choose_mat < 0.95) {
+          // metal
+          auto albedo = colour::random(gen, 0.5, 1);
+          auto fuzz = random_double(gen, 0, 0.5);
+          sphere_material = materials.add(metal(albedo, fuzz));
+          spheres.add(center, 0.2, sphere_material);
+        } else {
+          // glass
+          sphere_material = materials.add(dielectric(1.5));
+          spheres.add(center, 0.2, sphere_material);
+        }
+      }
+    }
+  }
+
+  auto material1 = materials.add(dielectric(1.5));
+  spheres.add(point3(0, 1, 0), 1.0, material1);
+
+  auto material2 = materials.add(lambertian(colour(0.4, 0.2, 0.1)));
+  spheres.add(point3(-4, 1, 0), 1.0, material2);
+
+  auto material3 = materials.add(metal(colour(0.7, 0.6, 0.5), 0.0));
+  spheres.add(point3(4, 1, 0), 1.0, material3);
+
+  result.build_world(accel);
+  return result;
+}
+
+void set_random_spheres_view(camera &cam) {
+  cam.vfov = 20;
+  cam.lookfrom = point3(13, 2, 3);
+  cam.lookat = point3(0, 0, 0);
+  cam.vup = vec3(0, 1, 0);
+
+  cam.defocus_angle = 0.6;
+  cam.focus_dist = 10.0;
+}
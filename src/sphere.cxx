@@ -1,11 +1,17 @@
 
 #include "sphere.hpp"
+#include "render_stats.hpp"
 
-sphere::sphere(const point3 &center, const double radius,
-               std::shared_ptr<material> mat)
-    : center(center), radius(std::fmax(0, radius)), mat(mat) {}
+sphere::sphere(const point3 &center, const real radius,
+               const material_id mat)
+    : center(center), radius(std::fmax(0, radius)), mat(mat) {
+  CONST_VAR auto rvec = vec3(this->radius, this->radius, this->radius);
+  bbox = aabb(center - rvec, center + rvec);
+}
 
-bool sphere::hit(const ray &r, interval ray_t, hit_record &rec) const {
+bool sphere::intersect(const ray &r, interval ray_t,
+                       hit_candidate &hit) const {
+  STATS_ADD(tests[int(primitive_kind::sphere)], 1);
   vec3 oc = center - r.origin();
   CONST_VAR auto a = r.direction().length_squared();
   CONST_VAR auto h = dot(r.direction(), oc);
@@ -25,10 +31,92 @@ bool sphere::hit(const ray &r, interval ray_t, hit_record &rec) const {
       return false;
   }
 
-  rec.t = root;
-  rec.p = r.at(rec.t);
-  CONST_VAR vec3 outward_normal = (rec.p - center) / radius;
+  STATS_ADD(hits[int(primitive_kind::sphere)], 1);
+  hit = {root, this, 0};
+  return true;
+}
+
+bool sphere::occluded(const ray &r, interval ray_t) const {
+  STATS_ADD(tests[int(primitive_kind::sphere)], 1);
+  CONST_VAR vec3 oc = center - r.origin();
+  CONST_VAR auto a = r.direction().length_squared();
+  CONST_VAR auto h = dot(r.direction(), oc);
+  CONST_VAR auto c = oc.length_squared() - radius * radius;
+
+  CONST_VAR auto discriminant = h * h - a * c;
+  if (discriminant < 0)
+    return false;
+  ASSUME(discriminant >= 0);
+  CONST_VAR auto sqrtd = std::sqrt(discriminant);
+  // Either root will do.
+  CONST_VAR bool hit = ray_t.surrounds((h - sqrtd) / a) ||
+                       ray_t.surrounds((h + sqrtd) / a);
+  STATS_ADD(hits[int(primitive_kind::sphere)], hit);
+  return hit;
+}
+
+unsigned sphere::intersect_packet(ray_packet &packet,
+                                  hit_candidate *hits) const {
+  constexpr int size = ray_packet::size;
+
+  // Compute the discriminant for all lanes at once; this loop vectorises and
+  // for most spheres already shows that no lane hits.
+  real a[size], h[size], discriminant[size];
+  for (int lane = 0; lane < size; lane++) {
+    CONST_VAR real ocx = center.x() - packet.origin_x[lane];
+    CONST_VAR real ocy = center.y() - packet.origin_y[lane];
+    CONST_VAR real ocz = center.z() - packet.origin_z[lane];
+    CONST_VAR real dx = packet.direction_x[lane];
+    CONST_VAR real dy = packet.direction_y[lane];
+    CONST_VAR real dz = packet.direction_z[lane];
+    a[lane] = dx * dx + dy * dy + dz * dz;
+    h[lane] = dx * ocx + dy * ocy + dz * ocz;
+    CONST_VAR real c = ocx * ocx + ocy * ocy + ocz * ocz - radius * radius;
+    discriminant[lane] = h[lane] * h[lane] - a[lane] * c;
+  }
+
+  unsigned candidates = 0;
+  for (int lane = 0; lane < size; lane++)
+    candidates |= unsigned(discriminant[lane] >= 0) << lane;
+  candidates &= packet.active;
+  STATS_ADD(tests[int(primitive_kind::sphere)],
+            __builtin_popcount(packet.active));
+
+  unsigned hit_lanes = 0;
+  while (candidates) {
+    CONST_VAR int lane = __builtin_ctz(candidates);
+    candidates &= candidates - 1;
+
+    ASSUME(discriminant[lane] >= 0);
+    CONST_VAR auto sqrtd = std::sqrt(discriminant[lane]);
+    CONST_VAR interval ray_t(packet.t_min, packet.t_max[lane]);
+    auto root = (h[lane] - sqrtd) / a[lane];
+    if (!ray_t.surrounds(root)) {
+      root = (h[lane] + sqrtd) / a[lane];
+      if (!ray_t.surrounds(root))
+        continue;
+    }
+
+    STATS_ADD(hits[int(primitive_kind::sphere)], 1);
+    hits[lane] = {root, this, 0};
+    packet.t_max[lane] = root;
+    hit_lanes |= 1u << lane;
+  }
+  return hit_lanes;
+}
+
+void sphere::finalize(const ray &r, const hit_candidate &hit,
+                      hit_record &rec) const {
+  STATS_ADD(finalizations, 1);
+  rec.t = hit.t;
+  // Project the hit point back onto the sphere, which bounds its error by the
+  // size of the sphere's coordinates rather than the distance it was seen
+  // from.
+  CONST_VAR vec3 outward_normal = unit_vector(r.at(rec.t) - center);
+  rec.p = center + radius * outward_normal;
+  rec.error = surface_error(max_abs(center) + radius);
   rec.set_face_normal(r, outward_normal);
   rec.mat = mat;
-  return true;
 }
+
+aabb sphere::bounding_box() const { return bbox; }
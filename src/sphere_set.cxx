@@ -0,0 +1,326 @@
+#include "sphere_set.hpp"
+#include "render_stats.hpp"
+
+#include <algorithm>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// SIMD lanes of real using the GCC/Clang vector extension, filling a 256-bit
+// register when the compiler targets AVX and a 128-bit one (SSE2 or NEON)
+// otherwise: four or two doubles, eight or four floats. The reduced alignment
+// allows unaligned loads straight from the coordinate arrays.
+#if defined(__AVX__)
+constexpr int lanes = 32 / sizeof(real);
+#else
+constexpr int lanes = 16 / sizeof(real);
+#endif
+typedef real realv
+    __attribute__((vector_size(lanes * sizeof(real)), aligned(sizeof(real))));
+
+inline realv broadcast(const real x) { return realv{} + x; }
+
+inline realv load(const real *p) { return *(const realv *)p; }
+
+inline realv lane_sqrt(const realv x) {
+#if defined(__AVX__) && ENABLE_FLOAT
+  return (realv)_mm256_sqrt_ps((__m256)x);
+#elif defined(__AVX__)
+  return (realv)_mm256_sqrt_pd((__m256d)x);
+#elif defined(__SSE2__) && ENABLE_FLOAT
+  return (realv)_mm_sqrt_ps((__m128)x);
+#elif defined(__SSE2__)
+  return (realv)_mm_sqrt_pd((__m128d)x);
+#else
+  realv result;
+  for (int k = 0; k < lanes; k++)
+    result[k] = std::sqrt(x[k]);
+  return result;
+#endif
+}
+
+// True if any lane of a comparison result is set.
+template <class mask> inline bool any_lane(const mask m) {
+#if defined(__AVX__) && ENABLE_FLOAT
+  return _mm256_movemask_ps((__m256)m) != 0;
+#elif defined(__AVX__)
+  return _mm256_movemask_pd((__m256d)m) != 0;
+#elif defined(__SSE2__) && ENABLE_FLOAT
+  return _mm_movemask_ps((__m128)m) != 0;
+#elif defined(__SSE2__)
+  return _mm_movemask_pd((__m128d)m) != 0;
+#else
+  for (int k = 0; k < lanes; k++)
+    if (m[k])
+      return true;
+  return false;
+#endif
+}
+
+} // namespace
+
+sphere_set::sphere_set() {}
+
+sphere_set::sphere_set(const std::size_t count, const real *center_x,
+                       const real *center_y, const real *center_z,
+                       const real *radius, const material_id *materials,
+                       std::shared_ptr<const void> storage)
+    : count(count), xs(center_x), ys(center_y), zs(center_z), radii(radius),
+      mats(materials), storage(std::move(storage)) {
+  // Accumulate the bounds per axis rather than through one aabb per sphere.
+  real low[3] = {std::numeric_limits<real>::infinity(),
+                 std::numeric_limits<real>::infinity(),
+                 std::numeric_limits<real>::infinity()};
+  real high[3] = {-low[0], -low[1], -low[2]};
+  const real *axes[3] = {xs, ys, zs};
+  for (int axis = 0; axis < 3; axis++) {
+    for (std::size_t i = 0; i < count; i++) {
+      CONST_VAR real r = radii[i];
+      low[axis] = std::fmin(low[axis], axes[axis][i] - r);
+      high[axis] = std::fmax(high[axis], axes[axis][i] + r);
+    }
+  }
+  if (count > 0)
+    bbox = aabb(point3(low[0], low[1], low[2]),
+                point3(high[0], high[1], high[2]));
+}
+
+void sphere_set::add(const point3 &center, const real radius,
+                     const material_id mat) {
+  own();
+  CONST_VAR real r = std::fmax(0, radius);
+  center_x.push_back(center.x());
+  center_y.push_back(center.y());
+  center_z.push_back(center.z());
+  radius_values.push_back(r);
+  materials.push_back(mat);
+  use_vectors();
+
+  CONST_VAR auto rvec = vec3(r, r, r);
+  bbox = aabb(bbox, aabb(center - rvec, center + rvec));
+}
+
+void sphere_set::clear() {
+  storage.reset();
+  center_x.clear();
+  center_y.clear();
+  center_z.clear();
+  radius_values.clear();
+  materials.clear();
+  use_vectors();
+  bbox = aabb();
+}
+
+std::size_t sphere_set::size() const { return count; }
+
+point3 sphere_set::center(const std::size_t i) const {
+  return point3(xs[i], ys[i], zs[i]);
+}
+
+real sphere_set::radius(const std::size_t i) const { return radii[i]; }
+
+material_id sphere_set::mat(const std::size_t i) const { return mats[i]; }
+
+const real *sphere_set::center_x_data() const { return xs; }
+
+const real *sphere_set::center_y_data() const { return ys; }
+
+const real *sphere_set::center_z_data() const { return zs; }
+
+const real *sphere_set::radius_data() const { return radii; }
+
+const material_id *sphere_set::material_data() const { return mats; }
+
+void sphere_set::own() {
+  if (!storage)
+    return;
+  center_x.assign(xs, xs + count);
+  center_y.assign(ys, ys + count);
+  center_z.assign(zs, zs + count);
+  radius_values.assign(radii, radii + count);
+  materials.assign(mats, mats + count);
+  storage.reset();
+  use_vectors();
+}
+
+void sphere_set::use_vectors() {
+  count = radius_values.size();
+  xs = center_x.data();
+  ys = center_y.data();
+  zs = center_z.data();
+  radii = radius_values.data();
+  mats = materials.data();
+}
+
+bool sphere_set::intersect(const ray &r, interval ray_t,
+                           hit_candidate &hit) const {
+  CONST_VAR int count = int(size());
+  STATS_ADD(tests[int(primitive_kind::sphere_set)], count);
+  const point3 &origin = r.origin();
+  const vec3 &direction = r.direction();
+
+  CONST_VAR realv ox = broadcast(origin.x());
+  CONST_VAR realv oy = broadcast(origin.y());
+  CONST_VAR realv oz = broadcast(origin.z());
+  CONST_VAR realv dx = broadcast(direction.x());
+  CONST_VAR realv dy = broadcast(direction.y());
+  CONST_VAR realv dz = broadcast(direction.z());
+  CONST_VAR realv a = broadcast(direction.length_squared());
+  CONST_VAR realv t_min = broadcast(ray_t.min);
+  CONST_VAR realv t_max = broadcast(ray_t.max);
+  realv lane_offsets;
+  for (int k = 0; k < lanes; k++)
+    lane_offsets[k] = k;
+
+  // Each lane keeps the nearest root it has seen; the lanes are reduced once
+  // all spheres have been tested. Indices are held as reals to share the
+  // comparison masks, which is exact for up to 2^24 spheres in float.
+  realv best_t = t_max;
+  realv best_index = broadcast(-1);
+
+  for (int base = 0; base < count; base += lanes) {
+    realv cx, cy, cz, rad;
+    realv indices = lane_offsets + broadcast(base);
+    if (base + lanes <= count) {
+      cx = load(&xs[base]);
+      cy = load(&ys[base]);
+      cz = load(&zs[base]);
+      rad = load(&radii[base]);
+    } else {
+      // Pad the final partial block with copies of its first sphere, which
+      // just repeat that sphere's result.
+      for (int k = 0; k < lanes; k++) {
+        CONST_VAR int i = (base + k < count) ? base + k : base;
+        cx[k] = xs[i];
+        cy[k] = ys[i];
+        cz[k] = zs[i];
+        rad[k] = radii[i];
+        indices[k] = i;
+      }
+    }
+
+    CONST_VAR realv ocx = cx - ox;
+    CONST_VAR realv ocy = cy - oy;
+    CONST_VAR realv ocz = cz - oz;
+    CONST_VAR realv h = dx * ocx + dy * ocy + dz * ocz;
+    CONST_VAR realv c = ocx * ocx + ocy * ocy + ocz * ocz - rad * rad;
+    CONST_VAR realv discriminant = h * h - a * c;
+
+    CONST_VAR auto real_roots = discriminant >= 0;
+    // Most rays miss most spheres, so skip the roots when every lane misses.
+    if (!any_lane(real_roots))
+      continue;
+    CONST_VAR realv sqrtd =
+        lane_sqrt(real_roots ? discriminant : broadcast(0));
+
+    // Nearest root that lies in the acceptable range, as in sphere::hit.
+    CONST_VAR realv near_root = (h - sqrtd) / a;
+    CONST_VAR realv far_root = (h + sqrtd) / a;
+    CONST_VAR auto near_ok = (near_root > t_min) & (near_root < best_t);
+    CONST_VAR auto far_ok = (far_root > t_min) & (far_root < best_t);
+    CONST_VAR realv root = near_ok ? near_root : far_root;
+    CONST_VAR auto closer = real_roots & (near_ok | far_ok);
+
+#if ENABLE_STATS
+    for (int k = 0; k < lanes; k++)
+      STATS_ADD(hits[int(primitive_kind::sphere_set)],
+                closer[k] && indices[k] == base + k);
+#endif
+    best_t = closer ? root : best_t;
+    best_index = closer ? indices : best_index;
+  }
+
+  int best_lane = -1;
+  real closest = ray_t.max;
+  for (int k = 0; k < lanes; k++) {
+    if (best_index[k] >= 0 && best_t[k] < closest) {
+      closest = best_t[k];
+      best_lane = k;
+    }
+  }
+  if (best_lane < 0)
+    return false;
+
+  hit = {closest, this, int(best_index[best_lane])};
+  return true;
+}
+
+bool sphere_set::occluded(const ray &r, interval ray_t) const {
+  CONST_VAR int count = int(size());
+  const point3 &origin = r.origin();
+  const vec3 &direction = r.direction();
+
+  CONST_VAR realv ox = broadcast(origin.x());
+  CONST_VAR realv oy = broadcast(origin.y());
+  CONST_VAR realv oz = broadcast(origin.z());
+  CONST_VAR realv dx = broadcast(direction.x());
+  CONST_VAR realv dy = broadcast(direction.y());
+  CONST_VAR realv dz = broadcast(direction.z());
+  CONST_VAR realv a = broadcast(direction.length_squared());
+  CONST_VAR realv t_min = broadcast(ray_t.min);
+  CONST_VAR realv t_max = broadcast(ray_t.max);
+
+  // As intersect(), but returning at the first block in which any lane has
+  // a root in range.
+  for (int base = 0; base < count; base += lanes) {
+    realv cx, cy, cz, rad;
+    if (base + lanes <= count) {
+      cx = load(&xs[base]);
+      cy = load(&ys[base]);
+      cz = load(&zs[base]);
+      rad = load(&radii[base]);
+    } else {
+      for (int k = 0; k < lanes; k++) {
+        CONST_VAR int i = (base + k < count) ? base + k : base;
+        cx[k] = xs[i];
+        cy[k] = ys[i];
+        cz[k] = zs[i];
+        rad[k] = radii[i];
+      }
+    }
+
+    CONST_VAR realv ocx = cx - ox;
+    CONST_VAR realv ocy = cy - oy;
+    CONST_VAR realv ocz = cz - oz;
+    CONST_VAR realv h = dx * ocx + dy * ocy + dz * ocz;
+    CONST_VAR realv c = ocx * ocx + ocy * ocy + ocz * ocz - rad * rad;
+    CONST_VAR realv discriminant = h * h - a * c;
+
+    CONST_VAR auto real_roots = discriminant >= 0;
+    if (!any_lane(real_roots))
+      continue;
+    CONST_VAR realv sqrtd =
+        lane_sqrt(real_roots ? discriminant : broadcast(0));
+    CONST_VAR realv near_root = (h - sqrtd) / a;
+    CONST_VAR realv far_root = (h + sqrtd) / a;
+    CONST_VAR auto near_ok = (near_root > t_min) & (near_root < t_max);
+    CONST_VAR auto far_ok = (far_root > t_min) & (far_root < t_max);
+    if (any_lane(real_roots & (near_ok | far_ok))) {
+      STATS_ADD(tests[int(primitive_kind::sphere_set)],
+                std::min(base + lanes, count));
+      STATS_ADD(hits[int(primitive_kind::sphere_set)], 1);
+      return true;
+    }
+  }
+  STATS_ADD(tests[int(primitive_kind::sphere_set)], count);
+  return false;
+}
+
+void sphere_set::finalize(const ray &r, const hit_candidate &hit,
+                          hit_record &rec) const {
+  STATS_ADD(finalizations, 1);
+  CONST_VAR int i = hit.primitive;
+  CONST_VAR point3 c = center(i);
+  rec.t = hit.t;
+  // Projected back onto the sphere, as in sphere::finalize.
+  CONST_VAR vec3 outward_normal = unit_vector(r.at(rec.t) - c);
+  rec.p = c + radii[i] * outward_normal;
+  rec.error = surface_error(max_abs(c) + radii[i]);
+  rec.set_face_normal(r, outward_normal);
+  rec.mat = mats[i];
+}
+
+aabb sphere_set::bounding_box() const { return bbox; }
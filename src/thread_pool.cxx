@@ -0,0 +1,109 @@
+#include "thread_pool.hpp"
+#include "rtweekend.hpp"
+
+thread_pool::thread_pool(int num_threads) {
+  num_threads = (num_threads < 1) ? 1 : num_threads;
+  for (int t = 0; t < num_threads; t++)
+    queues.push_back(std::make_unique<work_queue>());
+  for (int t = 1; t < num_threads; t++)
+    workers.emplace_back(&thread_pool::worker_loop, this, t);
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+int thread_pool::size() const { return int(queues.size()); }
+
+int thread_pool::default_threads() {
+  CONST_VAR auto hardware = std::thread::hardware_concurrency();
+  return hardware > 0 ? int(hardware) : 1;
+}
+
+void thread_pool::parallel_for(int count,
+                               const std::function<void(int, int)> &task) {
+  if (count <= 0)
+    return;
+
+  // Hand each thread a contiguous block of indices so that neighbouring tasks
+  // start out on the same thread; stealing rebalances the blocks later.
+  CONST_VAR int num_threads = size();
+  for (int t = 0; t < num_threads; t++) {
+    std::lock_guard<std::mutex> guard(queues[t]->lock);
+    CONST_VAR int begin = int(std::int64_t(count) * t / num_threads);
+    CONST_VAR int end = int(std::int64_t(count) * (t + 1) / num_threads);
+    for (int index = begin; index < end; index++)
+      queues[t]->items.push_back(index);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+    current_task = &task;
+    active_workers = int(workers.size());
+    generation++;
+  }
+  wake.notify_all();
+
+  run_tasks(0);
+
+  std::unique_lock<std::mutex> guard(state_lock);
+  finished.wait(guard, [this] { return active_workers == 0; });
+  current_task = nullptr;
+}
+
+void thread_pool::worker_loop(const int thread_id) {
+  std::uint64_t seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(state_lock);
+      wake.wait(guard, [&] {
+        return stopping || generation != seen_generation;
+      });
+      if (stopping)
+        return;
+      seen_generation = generation;
+    }
+
+    run_tasks(thread_id);
+
+    std::lock_guard<std::mutex> guard(state_lock);
+    if (--active_workers == 0)
+      finished.notify_all();
+  }
+}
+
+void thread_pool::run_tasks(const int thread_id) {
+  int index;
+  while (pop_task(thread_id, index) || steal_task(thread_id, index))
+    (*current_task)(thread_id, index);
+}
+
+bool thread_pool::pop_task(const int thread_id, int &index) {
+  auto &queue = *queues[thread_id];
+  std::lock_guard<std::mutex> guard(queue.lock);
+  if (queue.items.empty())
+    return false;
+  index = queue.items.front();
+  queue.items.pop_front();
+  return true;
+}
+
+bool thread_pool::steal_task(const int thread_id, int &index) {
+  CONST_VAR int num_threads = size();
+  for (int offset = 1; offset < num_threads; offset++) {
+    auto &victim = *queues[(thread_id + offset) % num_threads];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (victim.items.empty())
+      continue;
+    index = victim.items.back();
+    victim.items.pop_back();
+    return true;
+  }
+  return false;
+}
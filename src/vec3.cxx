@@ -1,24 +1,36 @@
 #include "vec3.hpp"
 
+#if ENABLE_SIMD_VEC3
+vec3::vec3() : v{0, 0, 0, 0} {}
+#else
 vec3::vec3() : e{0, 0, 0} {}
+#endif
 
-double &vec3::operator[](const int i) { return e[i]; }
+real &vec3::operator[](const int i) { return e[i]; }
 
 vec3 &vec3::operator+=(const vec3 &v) {
+#if ENABLE_SIMD_VEC3
+  this->v += v.v;
+#else
   e[0] += v.e[0];
   e[1] += v.e[1];
   e[2] += v.e[2];
+#endif
   return *this;
 }
 
-vec3 &vec3::operator*=(double t) {
+vec3 &vec3::operator*=(real t) {
+#if ENABLE_SIMD_VEC3
+  v *= t;
+#else
   e[0] *= t;
   e[1] *= t;
   e[2] *= t;
+#endif
   return *this;
 }
 
-vec3 &vec3::operator/=(double t) { return *this *= 1 / t; }
+vec3 &vec3::operator/=(real t) { return *this *= 1 / t; }
 
 bool vec3::near_zero() const {
   // Return true if the vector is close to zero in all dimensions.
@@ -27,11 +39,18 @@ bool vec3::near_zero() const {
          (std::fabs(e[2]) < s);
 }
 
-vec3 vec3::random() {
-  return vec3(random_double(), random_double(), random_double());
+vec3 vec3::random(rng &gen) {
+  // Draw the components in a fixed order; the order in which function
+  // arguments are evaluated is unspecified.
+  CONST_VAR auto x = random_double(gen);
+  CONST_VAR auto y = random_double(gen);
+  CONST_VAR auto z = random_double(gen);
+  return vec3(x, y, z);
 }
 
-vec3 vec3::random(const double min, const double max) {
-  return vec3(random_double(min, max), random_double(min, max),
-              random_double(min, max));
+vec3 vec3::random(rng &gen, const real min, const real max) {
+  CONST_VAR auto x = random_double(gen, min, max);
+  CONST_VAR auto y = random_double(gen, min, max);
+  CONST_VAR auto z = random_double(gen, min, max);
+  return vec3(x, y, z);
 }
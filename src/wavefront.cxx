@@ -0,0 +1,158 @@
+#include "wavefront.hpp"
+#include "interval.hpp"
+#include "render_stats.hpp"
+#include "russian_roulette.hpp"
+
+#include <type_traits>
+#include <utility>
+
+wavefront_integrator::wavefront_integrator(const hittable &world,
+                                           const material_table &materials,
+                                           const light_list &lights,
+                                           const int max_depth,
+                                           const int roulette_depth,
+                                           const bool light_sampling,
+                                           colour (*background)(const ray &r),
+                                           const double sky_brightness)
+    : world(world), materials(materials), lights(lights),
+      max_depth(max_depth), roulette_depth(roulette_depth),
+      sample_lights(light_sampling && !lights.empty()),
+      background(background), sky_brightness(sky_brightness) {}
+
+void wavefront_integrator::add_path(const ray &r, const sampler &gen) {
+  rays.push_back(r);
+  gens.push_back(gen);
+}
+
+int wavefront_integrator::size() const { return int(rays.size()); }
+
+void wavefront_integrator::clear() {
+  rays.clear();
+  gens.clear();
+}
+
+void wavefront_integrator::trace() {
+  CONST_VAR int num_paths = size();
+  throughputs.assign(num_paths, colour(1, 1, 1));
+  radiances.assign(num_paths, colour(0, 0, 0));
+  scatter_origins.resize(num_paths);
+  scatter_pdfs.assign(num_paths, 0);
+  live_paths.resize(num_paths);
+  for (int i = 0; i < num_paths; i++)
+    live_paths[i] = i;
+
+  // Paths still live after max_depth bounces gather no more light.
+  for (int bounces = 1; bounces <= max_depth && !live_paths.empty();
+       bounces++) {
+    intersect(bounces - 1);
+    partition_by_material();
+
+    next_live_paths.clear();
+    shade<lambertian>(kind_begin[int(material_kind::lambertian)],
+                      kind_begin[int(material_kind::lambertian) + 1], bounces);
+    shade<metal>(kind_begin[int(material_kind::metal)],
+                 kind_begin[int(material_kind::metal) + 1], bounces);
+    shade<dielectric>(kind_begin[int(material_kind::dielectric)],
+                      kind_begin[int(material_kind::dielectric) + 1], bounces);
+    shade<diffuse_light>(kind_begin[int(material_kind::diffuse_light)],
+                         kind_begin[int(material_kind::diffuse_light) + 1],
+                         bounces);
+    std::swap(live_paths, next_live_paths);
+  }
+}
+
+const colour &wavefront_integrator::radiance(const int i) const {
+  return radiances[i];
+}
+
+void wavefront_integrator::intersect(const int depth) {
+  CONST_VAR interval ray_t(0, std::numeric_limits<real>::infinity());
+  recs.resize(live_paths.size());
+  STATS_ADD(rays_by_depth[render_stats::depth_bucket(depth)],
+            live_paths.size());
+  hit_order.clear();
+
+  for (int pos = 0; pos < int(live_paths.size()); pos++) {
+    CONST_VAR int path = live_paths[pos];
+    if (world.hit(rays[path], ray_t, recs[pos]))
+      hit_order.push_back(pos);
+    else {
+      STATS_ADD(paths_escaped, 1);
+      radiances[path] +=
+          throughputs[path] * (sky_brightness * background(rays[path]));
+    }
+  }
+}
+
+void wavefront_integrator::partition_by_material() {
+  // Counting sort of the hits by material kind.
+  int counts[num_kinds] = {};
+  for (CONST_VAR int pos : hit_order)
+    counts[int(materials[recs[pos].mat].kind())]++;
+
+  kind_begin[0] = 0;
+  for (int k = 0; k < num_kinds; k++)
+    kind_begin[k + 1] = kind_begin[k] + counts[k];
+
+  int next[num_kinds];
+  for (int k = 0; k < num_kinds; k++)
+    next[k] = kind_begin[k];
+  sorted_hits.resize(hit_order.size());
+  for (CONST_VAR int pos : hit_order)
+    sorted_hits[next[int(materials[recs[pos].mat].kind())]++] = pos;
+  std::swap(hit_order, sorted_hits);
+}
+
+template <class mat_type>
+void wavefront_integrator::shade(const int begin, const int end,
+                                 const int bounces) {
+  // Every hit in [begin, end) has a material of type mat_type, so the scatter
+  // calls below need no dispatch on the material kind.
+  for (int k = begin; k < end; k++) {
+    CONST_VAR int pos = hit_order[k];
+    CONST_VAR int path = live_paths[pos];
+    const hit_record &rec = recs[pos];
+    const material &generic = materials[rec.mat];
+    CONST_VAR auto &mat = generic.as<mat_type>();
+
+    // The same light gathering as camera::hit_colour, in the same order.
+    if (std::is_same<mat_type, diffuse_light>::value)
+      radiances[path] +=
+          throughputs[path] * emitted_light(lights, generic, rec,
+                                            scatter_origins[path],
+                                            scatter_pdfs[path]);
+    gens[path].start_bounce(bounces);
+    CONST_VAR bool sampled_lights =
+        sample_lights && generic.diffuse() && bounces < max_depth;
+    if (sampled_lights)
+      radiances[path] +=
+          throughputs[path] *
+          sample_direct_light(world, lights, generic, rec, gens[path]);
+
+    ray scattered;
+    colour attenuation;
+    if (!mat.scatter(rays[path], rec, attenuation, scattered, gens[path])) {
+      STATS_ADD(paths_absorbed, 1);
+      continue;
+    }
+    throughputs[path] = throughputs[path] * attenuation;
+    // Same termination order as camera::hit_colour: no roulette after the
+    // last bounce.
+    if (bounces >= max_depth) {
+      STATS_ADD(paths_max_depth, 1);
+      continue;
+    }
+    if (!survives_roulette(throughputs[path], bounces, roulette_depth,
+                           gens[path])) {
+      STATS_ADD(paths_roulette, 1);
+      continue;
+    }
+    scatter_origins[path] = rec.p;
+    scatter_pdfs[path] = 0;
+    if (sampled_lights)
+      generic.evaluate(rec, unit_vector(scattered.direction()),
+                       scatter_pdfs[path]);
+    rays[path] = scattered;
+    next_live_paths.push_back(path);
+  }
+}